@@ -8,6 +8,8 @@
 
 #include "config.h"
 #include "text-fuzzy.h"
+#include "edit-distance-simd.h"
+#include "utf8.h"
 #include "text-fuzzy-perl.c"
 
 #undef FAIL_STATUS
@@ -25,6 +27,10 @@ BOOT:
 
 	text_fuzzy_error_handler = perl_error_handler;
 
+	/* Choose the SIMD instructions for the edit distance. */
+
+	distance_simd_init ();
+
 
 Text::Fuzzy
 new (class, search_term, ...)
@@ -75,7 +81,7 @@ CODE:
 			r->no_exact = SvTRUE (ST (i + 1)) ? 1 : 0;
 		}
 		else if (strncmp (p, "trans", strlen ("trans")) == 0) {
-			r->transpositions_ok = SvTRUE (ST (i + 1)) ? 1 : 0;
+			TEXT_FUZZY (set_transpositions (r, sv_to_transpositions (ST (i + 1))));
 		}
 		else {
 			warn ("Unknown parameter %s", p);
@@ -126,18 +132,21 @@ transpositions_ok (tf, trans)
 	Text::Fuzzy tf;
 	SV * trans;
 CODE:
-	if (SvTRUE (trans)) {
-		TEXT_FUZZY (set_transpositions (tf, 1));
-	}
-	else {
-		TEXT_FUZZY (set_transpositions (tf, 0));
-	}
+	TEXT_FUZZY (set_transpositions (tf, sv_to_transpositions (trans)));
 
-int
+SV *
 get_trans (tf)
 	Text::Fuzzy tf;
+PREINIT:
+	int trans;
 CODE:
-	TEXT_FUZZY (get_transpositions (tf, & RETVAL));
+	TEXT_FUZZY (get_transpositions (tf, & trans));
+	if (trans == TEXT_FUZZY_TRANS_OSA) {
+		RETVAL = newSVpv ("osa", 0);
+	}
+	else {
+		RETVAL = newSViv (trans);
+	}
 OUTPUT:
 	RETVAL
 
@@ -183,7 +192,7 @@ PPCODE:
 
 	if (wantarray) {
 		SV * e;
-		EXTEND (SP, av_len (wantarray));
+		EXTEND (SP, av_len (wantarray) + 1);
 		for (i = 0; i <= av_len (wantarray); i++) {
 			e = * av_fetch (wantarray, i, 0);
 			SvREFCNT_inc_simple_void_NN (e);
@@ -269,6 +278,14 @@ no_exact (tf, yes_no)
 CODE:
 	TEXT_FUZZY (set_no_exact (tf, SvTRUE (yes_no)));
 
+int
+qgram_rejections (tf)
+	Text::Fuzzy tf;
+CODE:
+	TEXT_FUZZY (qgram_rejections (tf, & RETVAL));
+OUTPUT:
+        RETVAL
+
 int
 alphabet_rejections (tf)
 	Text::Fuzzy tf;
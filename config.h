@@ -2,5 +2,20 @@
 #define TEXT_FUZZY_CONFIG
 #define NO_MAX_DISTANCE -1
 #define STRING_MAX_CHARS (0x1000 * 0x1000)
-#define UALPHABET_MAX_SIZE 0x10000
+#define MASKS_MAX_WORDS 0x20000
+#define PAIR_MASKS_MAX_WORDS 0x80000
+#define BATCH_MAX_WORDS 0x40
+#define DIAGONAL_MAX_DISTANCE 16
+#define DIAGONAL_LENGTH_RATIO 16
+#define WAVEFRONT_MIN_LENGTH 256
+#define WAVEFRONT_LENGTH_RATIO 64
+#define SEARCH_LENGTH_RATIO 4
+#define WITHIN_MAX_DISTANCE 2
+#define SHORT_MAX_LENGTH 16
+#define QGRAM_MIN_LENGTH 65
+#define QGRAM_LENGTH_RATIO 8
+#define ALPHABET_SIMD_MIN_LENGTH 16
+#define FILTER_SAMPLE_SIZE 0x100
+#define FILTER_MIN_REJECT_RATIO 16
+#define FILTER_SKIP_SIZE 0x1000
 #endif /* ndef TEXT_FUZZY_CONFIG */
@@ -0,0 +1,675 @@
+/* Bit-parallel edit distance algorithms.
+
+   These compute the same edit distances as the dynamic programming
+   algorithms in "edit-distance.c.tmpl", but instead of filling in
+   the matrix one cell at a time, they keep a whole column of the
+   matrix as the differences between vertically adjacent cells, in
+   bit vectors, and compute the next column with a handful of logical
+   and arithmetic operations. See
+
+   Gene Myers, "A fast bit-vector algorithm for approximate string
+   matching based on dynamic programming", Journal of the ACM 46
+   (1999), and
+
+   Heikki Hyyrö, "A bit-vector algorithm for computing Levenshtein
+   and Damerau edit distances", Nordic Journal of Computing 10
+   (2003).
+
+   If "tf->osa" is set, they compute the optimal string alignment
+   distance, in which two adjacent characters may be swapped at a
+   cost of one, but not edited again, using Hyyrö's extension of the
+   algorithm. The extra work is a few more logical operations per
+   column, so this costs about the same as the Levenshtein
+   distance.
+
+   If "tf->prefix" is not zero, "tf->text" is the search term without
+   its first "tf->prefix" characters, but the match masks are still
+   those of the whole search term, so they are shifted down by
+   "tf->prefix" bits. See "strip_affixes" in "text-fuzzy.c". Bits of
+   the masks above the last row do not matter, since nothing moves
+   down the columns. */
+
+#include <stdlib.h>
+
+#include "config.h"
+#include "text-fuzzy.h"
+#include "edit-distance-bits.h"
+#include "edit-distance-int-trans.h"
+#include "edit-distance-int.h"
+
+#ifdef __GNUC__
+#define INLINE inline
+#else
+#define INLINE
+#endif
+
+/* The top bit of a machine word. */
+
+#define TOP_BIT (((text_fuzzy_bits_t) 1) << (TEXT_FUZZY_BITS - 1))
+
+/* Count the bits set in "x". */
+
+static INLINE int bits_count (text_fuzzy_bits_t x)
+{
+#ifdef __GNUC__
+    return __builtin_popcountll (x);
+#else
+    int n;
+
+    n = 0;
+    while (x) {
+	x &= x - 1;
+	n++;
+    }
+    return n;
+#endif
+}
+
+/* Compute the Levenshtein edit distance between "tf->text" and
+   "tf->b" for byte strings where "tf->text" is no longer than
+   TEXT_FUZZY_BITS. The match masks of "tf->text" are in "tf->peq",
+   made by "text_fuzzy_generate_alphabet".
+
+   If "tf->max_distance" is set, the return value is only exact if
+   it is less than or equal to the maximum distance. Otherwise it is
+   some value greater than the maximum distance. */
+
+int distance_bits_char (text_fuzzy_t * tf)
+{
+    const unsigned char * word1 = (const unsigned char *) tf->b.text;
+    int len1 = tf->b.length;
+    int len2 = tf->text.length;
+
+    /* The vertical differences of the current column, as bit
+       vectors. A bit of "pv" is set if the cell is one more than the
+       cell above it, and a bit of "mv" is set if it is one less. */
+
+    text_fuzzy_bits_t pv;
+    text_fuzzy_bits_t mv;
+
+    /* The diagonal differences of the previous column, where a bit
+       is set if the cell is equal to the cell diagonally above and
+       to the left of it, and the match mask of the previous column,
+       for the optimal string alignment distance. */
+
+    text_fuzzy_bits_t d0_prev;
+    text_fuzzy_bits_t eq_prev;
+
+    /* The bit of the last row of the matrix. */
+
+    text_fuzzy_bits_t last;
+
+    /* The value of the last row of the current column. */
+
+    int score;
+    int max;
+    int osa;
+    int prefix;
+    int i;
+
+    if (len2 == 0) {
+	return len1;
+    }
+
+    max = tf->max_distance;
+    osa = tf->osa;
+    prefix = tf->prefix;
+    pv = ~ (text_fuzzy_bits_t) 0;
+    mv = 0;
+    d0_prev = ~ (text_fuzzy_bits_t) 0;
+    eq_prev = 0;
+    last = ((text_fuzzy_bits_t) 1) << (len2 - 1);
+    score = len2;
+
+    for (i = 0; i < len1; i++) {
+	text_fuzzy_bits_t eq;
+	text_fuzzy_bits_t x;
+	text_fuzzy_bits_t d0;
+	text_fuzzy_bits_t ph;
+	text_fuzzy_bits_t mh;
+
+	eq = tf->peq[word1[i]] >> prefix;
+	x = eq | mv;
+	d0 = (((x & pv) + pv) ^ pv) | x;
+	if (osa) {
+
+	    /* A cell where this column's character matches the row
+	       above, and the previous column's character matches this
+	       row, can be reached by a transposition from two rows
+	       and columns back, if that is cheaper than the
+	       diagonal. */
+
+	    d0 |= ((~ d0_prev & eq) << 1) & eq_prev;
+	    d0_prev = d0;
+	    eq_prev = eq;
+	}
+	ph = mv | ~ (d0 | pv);
+	mh = pv & d0;
+	if (ph & last) {
+	    score++;
+	}
+	else if (mh & last) {
+	    score--;
+	}
+
+	/* The top row of the matrix goes up by one in each column. */
+
+	ph = (ph << 1) | 1;
+	mh = mh << 1;
+	pv = mh | ~ (d0 | ph);
+	mv = ph & d0;
+
+	if (max != NO_MAX_DISTANCE) {
+
+	    /* Each remaining column can reduce the score by at most
+	       one, so if the score minus the number of remaining
+	       columns is greater than the maximum, give up. */
+
+	    if (score - (len1 - i - 1) > max) {
+		return max + 1;
+	    }
+	}
+    }
+    return score;
+}
+
+/* Find the match mask of Unicode character "c" in "m". Characters
+   which are not in the search term get the all-zero mask, from the
+   empty slot of the hash table which ends the search. */
+
+static INLINE const text_fuzzy_bits_t *
+unicode_mask (const text_fuzzy_masks_t * m, int c)
+{
+    return m->masks + text_fuzzy_char_row (m, c) * m->n_blocks;
+}
+
+/* Block "b" of the match mask "mask" of "m", for the search term
+   without its first "q * TEXT_FUZZY_BITS + r" characters. */
+
+static INLINE text_fuzzy_bits_t
+mask_block (const text_fuzzy_masks_t * m, const text_fuzzy_bits_t * mask,
+	    int b, int q, int r)
+{
+    text_fuzzy_bits_t eq;
+
+    b += q;
+    eq = mask[b];
+    if (r > 0) {
+	eq >>= r;
+	if (b + 1 < m->n_blocks) {
+	    eq |= mask[b + 1] << (TEXT_FUZZY_BITS - r);
+	}
+    }
+    return eq;
+}
+
+/* Compute the next column of one block of the matrix. "eq" is the
+   match mask of the block for the character of the column, "tr" is
+   the transposition bits for the optimal string alignment distance,
+   or zero, "hin" is the horizontal difference coming into the top of
+   the block, "* pv_ptr" and "* mv_ptr" are the vertical differences
+   of the block, which are updated, and "* d0_ptr" receives the
+   diagonal differences. The return value is the horizontal
+   difference at the row of the block given by "out". */
+
+static INLINE int
+advance_block (text_fuzzy_bits_t eq, text_fuzzy_bits_t tr, int hin,
+	       text_fuzzy_bits_t * pv_ptr, text_fuzzy_bits_t * mv_ptr,
+	       text_fuzzy_bits_t * d0_ptr, text_fuzzy_bits_t out)
+{
+    text_fuzzy_bits_t pv;
+    text_fuzzy_bits_t mv;
+    text_fuzzy_bits_t x;
+    text_fuzzy_bits_t d0;
+    text_fuzzy_bits_t ph;
+    text_fuzzy_bits_t mh;
+    int hout;
+
+    pv = * pv_ptr;
+    mv = * mv_ptr;
+    x = eq | mv | tr;
+
+    /* A transposition is treated like a match in the carry chain,
+       since below it the cells of a new block have only been
+       estimated, so that the cells under a transposition cannot be
+       relied on to be as cheap as they should be. */
+
+    eq |= tr;
+    if (hin < 0) {
+	eq |= 1;
+    }
+    d0 = (((eq & pv) + pv) ^ pv) | eq | mv;
+    * d0_ptr = d0;
+    ph = mv | ~ (d0 | pv);
+    mh = pv & d0;
+    hout = 0;
+    if (ph & out) {
+	hout = 1;
+    }
+    else if (mh & out) {
+	hout = -1;
+    }
+    ph <<= 1;
+    mh <<= 1;
+    if (hin < 0) {
+	mh |= 1;
+    }
+    else if (hin > 0) {
+	ph |= 1;
+    }
+    * pv_ptr = mh | ~ (x | ph);
+    * mv_ptr = ph & x;
+    return hout;
+}
+
+/* Compute the Levenshtein edit distance with the blocked version of
+   the bit-parallel algorithm. One of "bytes" or "chars" is the
+   string to compare with the search term, and the other one is
+   zero. "len1" is its length, and "len2" is the length of the search
+   term.
+
+   If there is a maximum distance, only the blocks which cross the
+   diagonal band of cells which may lie on a path within the maximum
+   distance are computed, and the computation stops if all of those
+   cells are over the maximum. In that case the return value is some
+   value greater than the maximum distance. */
+
+static int
+distance_blocks (text_fuzzy_t * tf, const text_fuzzy_masks_t * m,
+		 const unsigned char * bytes, const int * chars,
+		 int len1, int len2)
+{
+
+    /* The number of blocks of the search term, which may be fewer
+       than "m->n_blocks" if "tf->prefix" is set, and the number of
+       whole blocks and remaining bits of the prefix. */
+
+    int n_blocks;
+    int q;
+    int r;
+
+    /* The vertical differences of each block, as in
+       "distance_bits_char", the diagonal differences, and the value
+       of the last row of each block. These are in "tf->workspace". */
+
+    void * mem;
+    text_fuzzy_bits_t * pv;
+    text_fuzzy_bits_t * mv;
+    text_fuzzy_bits_t * d0;
+    int * score;
+
+    /* The match masks of the previous column, for the optimal
+       string alignment distance. */
+
+    const text_fuzzy_bits_t * eq_prev;
+
+    /* The width of the band. */
+
+    int k;
+
+    /* The band of rows of column "c" is from "c + lo" to "c + hi". */
+
+    int lo;
+    int hi;
+
+    /* The first and last blocks within the band. */
+
+    int first;
+    int last;
+
+    /* The bit of the last row of the last block, and the number of
+       rows in the last block. */
+
+    text_fuzzy_bits_t last_bit;
+    int last_rows;
+
+    /* True if there is a maximum distance. */
+
+    int bounded;
+    int osa;
+    int c;
+    int d;
+
+    if (len2 == 0) {
+	return len1;
+    }
+    if (len1 == 0) {
+	return len2;
+    }
+    n_blocks = (len2 + TEXT_FUZZY_BITS - 1) / TEXT_FUZZY_BITS;
+    q = tf->prefix / TEXT_FUZZY_BITS;
+    r = tf->prefix % TEXT_FUZZY_BITS;
+    osa = tf->osa;
+
+    k = tf->max_distance;
+    bounded = 1;
+    if (k == NO_MAX_DISTANCE || k >= len1 + len2) {
+	k = len1 + len2;
+	bounded = 0;
+    }
+    if (abs (len2 - len1) > k) {
+	return k + 1;
+    }
+
+    /* A cell in row "i" and column "c" can only be on a path of
+       cost "k" or less if the difference of "i" and "c" is "k" or
+       less, and the difference of the remaining lengths is "k" or
+       less. */
+
+    lo = - k;
+    hi = k;
+    if (len2 > len1) {
+	lo += len2 - len1;
+    }
+    else {
+	hi += len2 - len1;
+    }
+
+    last_rows = len2 - (n_blocks - 1) * TEXT_FUZZY_BITS;
+    last_bit = ((text_fuzzy_bits_t) 1) << (last_rows - 1);
+
+    if (text_fuzzy_workspace (tf, n_blocks * (3 * sizeof (text_fuzzy_bits_t) +
+					      sizeof (int)), & mem)
+	!= text_fuzzy_status_ok) {
+	/* The error handler has already been called. */
+	return k + 1;
+    }
+    pv = mem;
+    mv = pv + n_blocks;
+    d0 = mv + n_blocks;
+    score = (int *) (d0 + n_blocks);
+
+    first = 0;
+    last = -1;
+    d = -1;
+    eq_prev = m->masks;
+
+    for (c = 1; c <= len1; c++) {
+	const text_fuzzy_bits_t * eq;
+	int top;
+	int bottom;
+	int hin;
+	int b;
+
+	/* The first block of the previous column. */
+
+	int prev_first;
+
+	/* The bit carried from the top of the transpositions of one
+	   block into the bottom of the next one. */
+
+	text_fuzzy_bits_t carry;
+
+	if (bytes) {
+	    eq = m->masks + m->row[bytes[c - 1]] * m->n_blocks;
+	}
+	else {
+	    eq = unicode_mask (m, chars[c - 1]);
+	}
+
+	/* Work out which blocks of this column are inside the
+	   band. */
+
+	top = c + lo;
+	if (top < 1) {
+	    top = 1;
+	}
+	bottom = c + hi;
+	if (bottom > len2) {
+	    bottom = len2;
+	}
+	while (last < (bottom - 1) / TEXT_FUZZY_BITS) {
+
+	    /* Bring in a new block at the bottom. Its cells in the
+	       previous column are assumed to increase by one on each
+	       row, which is never less than their actual values. */
+
+	    int rows;
+
+	    last++;
+	    rows = TEXT_FUZZY_BITS;
+	    if (last == n_blocks - 1) {
+		rows = last_rows;
+	    }
+	    pv[last] = ~ (text_fuzzy_bits_t) 0;
+	    mv[last] = 0;
+	    d0[last] = ~ (text_fuzzy_bits_t) 0;
+	    if (last == 0) {
+		score[last] = rows;
+	    }
+	    else {
+		score[last] = score[last - 1] + rows;
+	    }
+	}
+	prev_first = first;
+	first = (top - 1) / TEXT_FUZZY_BITS;
+
+	/* The top of the first block is either the top row of the
+	   matrix, which increases by one in each column, or a cell
+	   outside the band, which we may assume does the same. */
+
+	hin = 1;
+	carry = 0;
+	if (osa && first > prev_first) {
+
+	    /* The last row of the block above the band was inside the
+	       band in the previous column, so a transposition into the
+	       top row of the band may still start from it. */
+
+	    carry = (~ d0[first - 1] & mask_block (m, eq, first - 1, q, r))
+		>> (TEXT_FUZZY_BITS - 1);
+	}
+	for (b = first; b <= last; b++) {
+	    text_fuzzy_bits_t out;
+	    text_fuzzy_bits_t tr;
+	    text_fuzzy_bits_t eq_b;
+
+	    eq_b = mask_block (m, eq, b, q, r);
+	    out = TOP_BIT;
+	    if (b == n_blocks - 1) {
+		out = last_bit;
+	    }
+	    tr = 0;
+	    if (osa) {
+		text_fuzzy_bits_t t;
+
+		/* See "distance_bits_char". */
+
+		t = ~ d0[b] & eq_b;
+		tr = ((t << 1) | carry) & mask_block (m, eq_prev, b, q, r);
+		carry = t >> (TEXT_FUZZY_BITS - 1);
+	    }
+	    hin = advance_block (eq_b, tr, hin, & pv[b], & mv[b], & d0[b],
+				 out);
+	    score[b] += hin;
+	}
+	eq_prev = eq;
+
+	if (bounded) {
+
+	    /* Give up if every cell in the band is over the maximum. The
+	       smallest value in a block is at least the value of its
+	       last row minus the number of rows which increase. */
+
+	    int over;
+
+	    over = 1;
+	    for (b = first; b <= last; b++) {
+		if (score[b] - bits_count (pv[b]) <= k) {
+		    over = 0;
+		    break;
+		}
+	    }
+	    if (over) {
+		d = k + 1;
+		tf->stopped = c;
+		break;
+	    }
+	}
+    }
+    if (d == -1) {
+	d = score[n_blocks - 1];
+    }
+
+    return d;
+}
+
+/* Compute the Levenshtein edit distance between "tf->text" and
+   "tf->b" for byte strings, using the match masks in "tf->masks". */
+
+int distance_bits_blocks_char (text_fuzzy_t * tf)
+{
+    return distance_blocks (tf, & tf->masks,
+			    (const unsigned char *) tf->b.text, 0,
+			    tf->b.length, tf->text.length);
+}
+
+/* Compute the Levenshtein edit distance between "tf->text" and
+   "tf->b" for Unicode strings, using the match masks in
+   "tf->masks". */
+
+int distance_bits_blocks_int (text_fuzzy_t * tf)
+{
+    return distance_blocks (tf, & tf->masks, 0, tf->b.unicode,
+			    tf->b.ulength, tf->text.ulength);
+}
+
+/* Compute the edit distance between "tf->text" and "tf->b" for
+   Unicode search terms with too many different characters for the
+   match masks of all of them to fit into MASKS_MAX_WORDS words, so
+   "tf->masks" only has the hash table of the characters.
+
+   Only the characters which are in both strings need match masks,
+   and there are usually far fewer of those, so this makes the match
+   masks of those characters for this comparison, in
+   "tf->masks_workspace", and then uses the blocked bit-parallel
+   algorithm. The time to make the masks is proportional to the
+   lengths of the strings and the size of the masks, which is no more
+   than the time the bit-parallel algorithm takes, so this is much
+   quicker than the dynamic programming algorithms for long strings.
+   If even those masks are too many, this falls back to the dynamic
+   programming algorithms.
+
+   Like "distance_bits_blocks_int", this also computes the optimal
+   string alignment distance if "tf->osa" is set. */
+
+int distance_bits_pair_int (text_fuzzy_t * tf)
+{
+    const int * word1 = tf->b.unicode;
+    int len1 = tf->b.ulength;
+    const int * word2 = tf->text.unicode;
+    int len2 = tf->text.ulength;
+
+    /* The hash table and match masks of the search term. */
+
+    const text_fuzzy_masks_t * t;
+
+    /* The hash table and match masks of the characters in both
+       strings. */
+
+    text_fuzzy_masks_t p;
+
+    /* The number of each character of the search term in "p", or
+       zero if it is not in "tf->b", indexed by its number in "t",
+       in "tf->workspace". */
+
+    int * pair_row;
+
+    void * mem;
+    int n_pair;
+    int n_words;
+    int bits;
+    int i;
+
+    if (len1 == 0) {
+	return len2;
+    }
+    if (len2 == 0) {
+	return len1;
+    }
+    t = & tf->masks;
+
+    /* Number the characters of the search term which are also in
+       "tf->b". */
+
+    if (text_fuzzy_workspace (tf, (t->n_chars + 1) * sizeof (int), & mem)
+	!= text_fuzzy_status_ok) {
+	/* The error handler has already been called. */
+	return len1 + len2 + 1;
+    }
+    pair_row = (int *) mem;
+    for (i = 0; i <= t->n_chars; i++) {
+	pair_row[i] = 0;
+    }
+    n_pair = 0;
+    for (i = 0; i < len1; i++) {
+	int row;
+
+	row = text_fuzzy_char_row (t, word1[i]);
+	if (row && ! pair_row[row]) {
+	    n_pair++;
+	    pair_row[row] = n_pair;
+	}
+    }
+    if (t->n_blocks > PAIR_MASKS_MAX_WORDS / (n_pair + 1)) {
+	if (tf->transpositions_ok) {
+	    return distance_int_trans (tf);
+	}
+	return distance_int (tf);
+    }
+
+    /* Make the hash table and the match masks. The masks are of the
+       whole search term, like "tf->masks", so the characters of
+       "tf->text" start at bit "tf->prefix". */
+
+    bits = 2;
+    while ((1 << bits) < 2 * n_pair) {
+	bits++;
+    }
+    p.n_blocks = t->n_blocks;
+    p.n_chars = n_pair;
+    p.n_slots = 1 << bits;
+    p.shift = 32 - bits;
+    n_words = (n_pair + 1) * p.n_blocks;
+    if (text_fuzzy_masks_workspace (tf, n_words * sizeof (text_fuzzy_bits_t) +
+				    p.n_slots * sizeof (text_fuzzy_char_t),
+				    & mem)
+	!= text_fuzzy_status_ok) {
+	return len1 + len2 + 1;
+    }
+    p.masks = (text_fuzzy_bits_t *) mem;
+    p.chars = (text_fuzzy_char_t *) (p.masks + n_words);
+    for (i = 0; i < n_words; i++) {
+	p.masks[i] = 0;
+    }
+    for (i = 0; i < p.n_slots; i++) {
+	p.chars[i].c = -1;
+	p.chars[i].row = 0;
+    }
+    for (i = 0; i < t->n_slots; i++) {
+	int c;
+	int row;
+	unsigned int slot;
+
+	c = t->chars[i].c;
+	if (c < 0 || ! pair_row[t->chars[i].row]) {
+	    continue;
+	}
+	row = pair_row[t->chars[i].row];
+	slot = text_fuzzy_char_slot (& p, c);
+	p.chars[slot].c = c;
+	p.chars[slot].row = row;
+    }
+    for (i = 0; i < len2; i++) {
+	int row;
+	int j;
+
+	row = pair_row[text_fuzzy_char_row (t, word2[i])];
+	if (row) {
+	    j = i + tf->prefix;
+	    p.masks[row * p.n_blocks + j / TEXT_FUZZY_BITS] |=
+		((text_fuzzy_bits_t) 1) << (j % TEXT_FUZZY_BITS);
+	}
+    }
+    return distance_blocks (tf, & p, 0, word1, len1, len2);
+}
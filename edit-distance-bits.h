@@ -0,0 +1,7 @@
+#ifndef EDIT_DISTANCE_BITS_H
+#define EDIT_DISTANCE_BITS_H
+int distance_bits_char (text_fuzzy_t * tf);
+int distance_bits_blocks_char (text_fuzzy_t * tf);
+int distance_bits_blocks_int (text_fuzzy_t * tf);
+int distance_bits_pair_int (text_fuzzy_t * tf);
+#endif /* EDIT_DISTANCE_BITS_H */
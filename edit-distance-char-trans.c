@@ -1,4 +1,3 @@
-#line 2 "edit-distance.c.tmpl"
 #include <string.h>
 #include <stdio.h>
 /* For INT_MAX/INT_MIN */
@@ -9,194 +8,73 @@
 #include "config.h"
 #include "text-fuzzy.h"
 #include "edit-distance-char-trans.h"
-#line 14 "edit-distance.c.tmpl"
 
+/* This computes the Damerau-Levenshtein distance using the linear
+   space algorithm of Chunchun Zhao and Sartaj Sahni, "Linear space
+   string correction algorithm using the Damerau-Levenshtein
+   distance", BMC Bioinformatics 21 (2020). Instead of keeping the
+   whole matrix for the transpositions, it keeps the last three rows,
+   plus the value diagonally before each column's most recent match
+   in "first_row".
 
-/* Our unsorted dictionary linked list.       */
+   If there is a maximum distance, only the cells within the maximum
+   distance of the diagonal are computed, and the computation stops
+   as soon as every cell of a row is over the maximum.
 
-struct dictionary {
-    unsigned char key;    /* the character        */
-    unsigned int value;  /* character occurance  */
-    struct dictionary* next;
-};
+   If "tf->osa" is set, this computes the optimal string alignment
+   distance instead, in which a transposed pair of characters may not
+   be edited again. This is only used if the bit-parallel algorithm
+   cannot be used. */
 
-typedef struct dictionary item;
+#define TRANS_CHAR_T unsigned char
+#define TRANS_TEXT text
+#define TRANS_LENGTH length
 
-/* http://ppm4.activestate.com/sun4-solaris-64/5.12/1200/B/BK/BKB/Text-Fuzzy-0.11.d/log-20130328T025706.txt */
+/* The calculation with matrix cells of type "unsigned char". */
 
-#ifdef __GNUC__
-#define INLINE inline
-#else
-#define INLINE 
-#endif
+#define TRANS_FUNCTION distance_char_trans_uchar
+#define CELL_T unsigned char
+#include "edit-distance-trans.h"
 
-static INLINE item * push (unsigned int key, item * curr)
-{
-    item * head;
-    head = malloc (sizeof (item));   
-    head->key = key;
-    head->value = 0;
-    head->next = curr;
-    return head;
-}
-
-static INLINE item * find (item * head, unsigned int key)
-{
-    item * iterator = head;
-    while (iterator) {
-	if (iterator->key == key){
-	    return iterator;
-	}
-	iterator = iterator->next;
-    }
-    return NULL;
-}
+/* The calculation with matrix cells of type "unsigned short". */
 
-/* find & push in 1 function (sperg optimization) */
+#define TRANS_FUNCTION distance_char_trans_ushort
+#define CELL_T unsigned short
+#include "edit-distance-trans.h"
 
-static INLINE item * uniquePush (item * head, unsigned int key)
-{
-    item * iterator = head;
+/* The calculation with matrix cells of type "int". */
 
-    while(iterator){
-	if(iterator->key == key){
-	    return head;
-	}
-	iterator = iterator->next;
-    }
-    return push(key,head); 
-}
+#define TRANS_FUNCTION distance_char_trans_int
+#define CELL_T int
+#include "edit-distance-trans.h"
 
-/* Free the memory associated with "head". */
+/* Choose the narrowest type for the cells of the matrix which can
+   hold every value the calculation stores. This is the larger of
+   the lengths of the strings, or the maximum distance plus one. */
 
-static void dict_free (item * head)
+int distance_char_trans (text_fuzzy_t * tf)
 {
-    item * iterator = head;
-    while(iterator){
-	item * temp = iterator;
-	iterator = iterator->next;
-	free(temp);
-    }
-    
-    head = NULL;
-}
-
-static int minimum (int a, int b)
-{
-    if (a > b) {
-	return b;
-    }
-    return a;
-}
-
-
-#line 1 "declaration"
-int distance_char_trans (
-                    text_fuzzy_t * tf)
-
-{
-#line 99 "edit-distance.c.tmpl"
-
-
-
-
-#line 110 "edit-distance.c.tmpl"
-    const unsigned char * word1 = (const unsigned char *) tf->b.text;
     int len1 = tf->b.length;
-    const unsigned char * word2 = (const unsigned char *) tf->text.text;
     int len2 = tf->text.length;
+    int max;
+    int bound;
 
-
-    /* keep track of dictionary linked list position */
-
-    item *head = NULL;
-
-    unsigned int swapScore,targetCharCount,i;
-    unsigned int score_ceil = len1 + len2;
-#ifdef __GNUC__
-    unsigned int matrix[len1 + 2][len2 + 2];
-#else
-    unsigned int ** matrix;
-    int d;
-#endif
-
-#ifndef __GNUC__
-    matrix = calloc (len1 + 2, sizeof (unsigned int *));
-    for (i = 0; i < len1 + 2; i++) {
-	matrix[i] = calloc (len2 + 2, sizeof (unsigned int));
+    max = tf->max_distance;
+    if (max == NO_MAX_DISTANCE || max > len1 + len2) {
+	max = len1 + len2;
     }
-#endif
-
-    if (len1 == 0) {
-	return len2;
+    bound = max + 1;
+    if (len1 > bound) {
+	bound = len1;
     }
-    if (len2 == 0) {
-	return len1;
+    if (len2 > bound) {
+	bound = len2;
     }
- 
-    /* intialize matrix start values */
-
-    matrix[0][0] = score_ceil;  
-    matrix[1][0] = score_ceil;
-    matrix[0][1] = score_ceil;
-    matrix[1][1] = 0;
-
-    head = uniquePush (uniquePush (head, word1[0]), word2[0]);
-
-    for (i = 1; i <= len1; i++) { 
-	int swapCount;
-	int j;
-
-	head = uniquePush (head, word1[i]);
-	matrix[i+1][1] = i;
-	matrix[i+1][0] = score_ceil;
-	
-	swapCount = 0;
-
-	for (j = 1; j <= len2; j++){
-	    if (i == 1) {
-		/* only initialize on the first pass     */
-		/* optimized over 2 additional for loops */
-		head = uniquePush (head, word2[j]);
-		matrix[1][j + 1] = j;
-		matrix[0][j + 1] = score_ceil;
-	    }
-
-	    targetCharCount = find (head, word2[j-1])->value;
-
-	    swapScore = matrix[targetCharCount][swapCount] + i - targetCharCount - 1 + j - swapCount;
-	    
-	    if(word1[i-1] != word2[j-1]){      
-		matrix[i+1][j + 1] = minimum(swapScore,(minimum(matrix[i][j], minimum(matrix[i+1][j], matrix[i][j + 1])) + 1));
-	    }
-	    else{ 
-		swapCount = j;
-		matrix[i+1][j + 1] = minimum (matrix[i][j], swapScore);
-	    } 
-	}
-	
-	find (head, word1[i-1])->value = i;
+    if (bound <= UCHAR_MAX) {
+	return distance_char_trans_uchar (tf);
     }
-
-    dict_free (head);
-
-#ifdef __GNUC__
-
-    return matrix[len1 + 1][len2 + 1];
-
-#else
-
-    d = matrix[len1 + 1][len2 + 1];
-
-    for (i = 0; i < len1 + 2; i++) {
-	free (matrix[i]);
+    if (bound <= USHRT_MAX) {
+	return distance_char_trans_ushort (tf);
     }
-    free (matrix);
-
-    return d;
-
-#endif
-
-#line 372 "edit-distance.c.tmpl"
+    return distance_char_trans_int (tf);
 }
-
@@ -28,14 +28,10 @@ int distance_char (
 #line 209 "edit-distance.c.tmpl"
 
     /* Matrix is the dynamic programming matrix. We economize on space
-       by having only two columns. */
+       by having only two columns, which are kept in "tf->workspace". */
 
-#ifdef __GNUC__
-    int matrix[2][len2 + 1];
-#else
     int * matrix[2];
-    int d;
-#endif
+    void * mem;
     int i;
     int j;
     int large_value;
@@ -46,11 +42,11 @@ int distance_char (
     max = tf->max_distance;
 #line 230 "edit-distance.c.tmpl"
 
-#ifndef __GNUC__
-    for (i = 0; i < 2; i++) {
-	matrix[i] = calloc (len2 + 1, sizeof (int));
+    if (len2 == 0) {
+	/* There are no rows, so the loop below would never find a
+	   column minimum. */
+	return len1;
     }
-#endif
 
     /*
       Initialize the 0 row of "matrix".
@@ -74,6 +70,14 @@ int distance_char (
         }
     }
 
+    if (text_fuzzy_workspace (tf, 2 * (len2 + 1) * sizeof (int), & mem)
+	!= text_fuzzy_status_ok) {
+	/* The error handler has already been called. */
+	return large_value;
+    }
+    matrix[0] = mem;
+    matrix[1] = matrix[0] + len2 + 1;
+
     for (j = 0; j <= len2; j++) {
         matrix[0][j] = j;
     }
@@ -161,30 +165,12 @@ int distance_char (
                 /* All the elements of the ith column are greater than the
                    maximum, so no match less than or equal to max can be
                    found by looking at succeeding columns. */
-
-#ifndef __GNUC__
-		for (i = 0; i < 2; i++) {
-		    free (matrix[i]);
-		}
-#endif
                 return large_value;
             }
         }
     }
-#ifdef __GNUC__
-
     return matrix[len1 % 2][len2];
 
-#else
-    d = matrix[len1 % 2][len2];
-
-    for (i = 0; i < 2; i++) {
-	free (matrix[i]);
-    }
-
-    return d;
-#endif
-
 #line 372 "edit-distance.c.tmpl"
 }
 
@@ -0,0 +1,266 @@
+/* Levenshtein edit distance by diagonal transitions, for small
+   maximum distances.
+
+   Instead of filling in cells, this finds, for each number of edits
+   "e" from zero up to the maximum distance, and each diagonal of the
+   matrix, the furthest row which can be reached with "e" edits. After
+   each edit, it slides along the diagonal for as long as the
+   characters match, which costs nothing. The distance is the first
+   "e" for which the furthest row on the diagonal of the bottom right
+   corner of the matrix is the last row. See
+
+   Esko Ukkonen, "Algorithms for approximate string matching",
+   Information and Control 64 (1985), and
+
+   Gad M. Landau and Uzi Vishkin, "Fast string matching with k
+   differences", Journal of Computer and System Sciences 37 (1988).
+
+   The time taken is proportional to the square of the maximum
+   distance plus the length of the slides, so this is used instead of
+   the other algorithms when there is a small maximum distance. The
+   slides over byte strings compare a machine word at a time.
+
+   With no maximum distance, the work depends on the distance itself,
+   so it is also tried first for long strings, which are often nearly
+   the same, such as two versions of a document. If the distance
+   turns out to be more than a small fraction of the length, it gives
+   up and leaves the distance to the bit-parallel algorithms.
+
+   This does not handle transpositions. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "config.h"
+#include "text-fuzzy.h"
+#include "edit-distance-diagonal.h"
+
+/* The number of bytes at the start of "a" and "b", of which there are
+   at least "n", which are the same. This compares a machine word at a
+   time until it finds one which differs. */
+
+int diagonal_common_prefix (const unsigned char * a, const unsigned char * b,
+			    int n)
+{
+    int i;
+
+    i = 0;
+    while (i + (int) sizeof (text_fuzzy_bits_t) <= n) {
+	text_fuzzy_bits_t x;
+	text_fuzzy_bits_t y;
+
+	memcpy (& x, a + i, sizeof (x));
+	memcpy (& y, b + i, sizeof (y));
+	if (x != y) {
+	    break;
+	}
+	i += sizeof (text_fuzzy_bits_t);
+    }
+    while (i < n && a[i] == b[i]) {
+	i++;
+    }
+    return i;
+}
+
+/* A row which is not reachable. This is small enough that adding one
+   to it leaves it unreachable, and that it loses to any reachable
+   row. */
+
+#define UNREACHED (INT_MIN / 2)
+
+/* Compute the edit distance between "word1", of length "len1", and
+   "word2", of length "len2", which are either "bytes1" and "bytes2",
+   or "chars1" and "chars2". If the distance is more than "max", the
+   return value is "max + 1". */
+
+static int
+distance_diagonals (text_fuzzy_t * tf,
+		    const unsigned char * bytes1, const unsigned char * bytes2,
+		    const int * chars1, const int * chars2,
+		    int len1, int len2, int max)
+{
+    /* The furthest row of each diagonal for the previous and the
+       current number of edits. Diagonal "d" is the cells where the
+       column minus the row is "d", and it is at "d + max + 1", so that
+       the diagonals either side of the ones in use can be read. */
+
+    void * mem;
+    int * prev;
+    int * cur;
+
+    /* The diagonal of the bottom right corner of the matrix. */
+
+    int target;
+    int n_diagonals;
+    int e;
+    int d;
+
+    target = len2 - len1;
+    if (abs (target) > max) {
+	return max + 1;
+    }
+    n_diagonals = 2 * max + 3;
+    if (text_fuzzy_workspace (tf, 2 * n_diagonals * sizeof (int), & mem)
+	!= text_fuzzy_status_ok) {
+	/* The error handler has already been called. */
+	return max + 1;
+    }
+    prev = mem;
+    cur = prev + n_diagonals;
+    for (d = 0; d < n_diagonals; d++) {
+	prev[d] = UNREACHED;
+	cur[d] = UNREACHED;
+    }
+    prev += max + 1;
+    cur += max + 1;
+
+    for (e = 0; e <= max; e++) {
+	int lo;
+	int hi;
+	int * swap;
+
+	/* Only diagonals within "e" of the main diagonal can be
+	   reached, and only those which are inside the matrix. */
+
+	lo = - e;
+	if (lo < - len1) {
+	    lo = - len1;
+	}
+	hi = e;
+	if (hi > len2) {
+	    hi = len2;
+	}
+	for (d = lo; d <= hi; d++) {
+	    int i;
+	    int end;
+
+	    if (e == 0) {
+		i = 0;
+	    }
+	    else {
+		/* A substitution, a deletion from "word1", which moves
+		   down a row from the diagonal to the right, or an
+		   insertion, which moves right from the diagonal to the
+		   left. */
+
+		i = prev[d] + 1;
+		if (prev[d + 1] + 1 > i) {
+		    i = prev[d + 1] + 1;
+		}
+		if (prev[d - 1] > i) {
+		    i = prev[d - 1];
+		}
+	    }
+
+	    /* Stay inside the matrix. */
+
+	    end = len1;
+	    if (len2 - d < end) {
+		end = len2 - d;
+	    }
+	    if (i > end) {
+		i = end;
+	    }
+	    if (i < - d) {
+		/* This diagonal has not been reached yet. */
+		cur[d] = UNREACHED;
+		continue;
+	    }
+
+	    /* Slide along the diagonal over matching characters. */
+
+	    if (bytes1) {
+		i += diagonal_common_prefix (bytes1 + i, bytes2 + i + d,
+					     end - i);
+	    }
+	    else {
+		while (i < end && chars1[i] == chars2[i + d]) {
+		    i++;
+		}
+	    }
+	    cur[d] = i;
+	}
+	if (target >= lo && target <= hi && cur[target] == len1) {
+	    return e;
+	}
+	swap = prev;
+	prev = cur;
+	cur = swap;
+    }
+    return max + 1;
+}
+
+/* Compute the Levenshtein edit distance between "tf->text" and
+   "tf->b" for byte strings. There must be a maximum distance. */
+
+int distance_diagonal_char (text_fuzzy_t * tf)
+{
+    return distance_diagonals (tf, (const unsigned char *) tf->b.text,
+			       (const unsigned char *) tf->text.text, 0, 0,
+			       tf->b.length, tf->text.length,
+			       tf->max_distance);
+}
+
+/* Compute the Levenshtein edit distance between "tf->text" and
+   "tf->b" for Unicode strings. There must be a maximum distance. */
+
+int distance_diagonal_int (text_fuzzy_t * tf)
+{
+    return distance_diagonals (tf, 0, 0, tf->b.unicode, tf->text.unicode,
+			       tf->b.ulength, tf->text.ulength,
+			       tf->max_distance);
+}
+
+/* The number of edits after which "distance_wavefront" gives up, for
+   strings of lengths "len1" and "len2". Up to this, following the
+   diagonals does less work than the bit-parallel algorithms, even if
+   it then gives up. */
+
+static int
+wavefront_max (int len1, int len2)
+{
+    if (len1 > len2) {
+	return len1 / WAVEFRONT_LENGTH_RATIO;
+    }
+    return len2 / WAVEFRONT_LENGTH_RATIO;
+}
+
+/* Compute the Levenshtein edit distance between "tf->text" and
+   "tf->b" for byte strings with no maximum distance, if the strings
+   are nearly the same. The return value is -1 if the distance is
+   more than "wavefront_max" allows, and another algorithm must be
+   used. */
+
+int distance_wavefront_char (text_fuzzy_t * tf)
+{
+    int max;
+    int d;
+
+    max = wavefront_max (tf->b.length, tf->text.length);
+    d = distance_diagonals (tf, (const unsigned char *) tf->b.text,
+			    (const unsigned char *) tf->text.text, 0, 0,
+			    tf->b.length, tf->text.length, max);
+    if (d > max) {
+	return -1;
+    }
+    return d;
+}
+
+/* Compute the Levenshtein edit distance between "tf->text" and
+   "tf->b" for Unicode strings with no maximum distance, if the
+   strings are nearly the same, as "distance_wavefront_char". */
+
+int distance_wavefront_int (text_fuzzy_t * tf)
+{
+    int max;
+    int d;
+
+    max = wavefront_max (tf->b.ulength, tf->text.ulength);
+    d = distance_diagonals (tf, 0, 0, tf->b.unicode, tf->text.unicode,
+			    tf->b.ulength, tf->text.ulength, max);
+    if (d > max) {
+	return -1;
+    }
+    return d;
+}
@@ -0,0 +1,8 @@
+#ifndef EDIT_DISTANCE_DIAGONAL_H
+#define EDIT_DISTANCE_DIAGONAL_H
+int diagonal_common_prefix (const unsigned char * a, const unsigned char * b, int n);
+int distance_diagonal_char (text_fuzzy_t * tf);
+int distance_diagonal_int (text_fuzzy_t * tf);
+int distance_wavefront_char (text_fuzzy_t * tf);
+int distance_wavefront_int (text_fuzzy_t * tf);
+#endif /* EDIT_DISTANCE_DIAGONAL_H */
@@ -0,0 +1,159 @@
+/* Edit distance for Unicode search terms of up to SHORT_MAX_LENGTH
+   characters.
+
+   This is the bit-parallel algorithm of "distance_bits_char", with
+   the whole column of the matrix in one register. Instead of looking
+   up the match mask of each character in the hash table of
+   "tf->masks" with "text_fuzzy_char_row", which needs a hash and a
+   probe for each character, and the block structure of
+   "distance_bits_blocks_int", the characters of the search term are
+   kept in vector registers, and
+   the match mask is made by comparing all of them with the character
+   at once. So there is no setup for each comparison, and no memory
+   is used apart from the strings.
+
+   Like "distance_bits_char", this computes the optimal string
+   alignment distance if "tf->osa" is set, but it does not handle
+   the Damerau-Levenshtein distance. */
+
+#include <stdlib.h>
+
+#include "config.h"
+#include "text-fuzzy.h"
+#include "edit-distance-short.h"
+
+#if defined (__SSE2__) && SHORT_MAX_LENGTH == 16
+#define SHORT_SSE2
+#include <emmintrin.h>
+#endif
+
+/* The search term, padded with characters which match nothing. */
+
+typedef struct {
+#ifdef SHORT_SSE2
+    __m128i v[4];
+#endif
+    int c[SHORT_MAX_LENGTH];
+}
+short_text_t;
+
+/* The match mask of "c" in "t", with bit "j" set if character "j" of
+   the search term is "c". */
+
+static unsigned int
+short_mask (const short_text_t * t, int c)
+{
+#ifdef SHORT_SSE2
+    __m128i x;
+    unsigned int eq;
+
+    x = _mm_set1_epi32 (c);
+    eq = _mm_movemask_ps (_mm_castsi128_ps (_mm_cmpeq_epi32 (t->v[0], x)));
+    eq |= _mm_movemask_ps (_mm_castsi128_ps (_mm_cmpeq_epi32 (t->v[1], x)))
+	<< 4;
+    eq |= _mm_movemask_ps (_mm_castsi128_ps (_mm_cmpeq_epi32 (t->v[2], x)))
+	<< 8;
+    eq |= _mm_movemask_ps (_mm_castsi128_ps (_mm_cmpeq_epi32 (t->v[3], x)))
+	<< 12;
+    return eq;
+#else
+    unsigned int eq;
+    int j;
+
+    eq = 0;
+    for (j = 0; j < SHORT_MAX_LENGTH; j++) {
+	eq |= ((unsigned int) (t->c[j] == c)) << j;
+    }
+    return eq;
+#endif
+}
+
+/* Compute the edit distance between "tf->text" and "tf->b", where
+   "tf->text" has at most SHORT_MAX_LENGTH characters. */
+
+int distance_short_int (text_fuzzy_t * tf)
+{
+    const int * word1 = tf->b.unicode;
+    int len1 = tf->b.ulength;
+    const int * word2 = tf->text.unicode;
+    int len2 = tf->text.ulength;
+
+    short_text_t t;
+
+    /* The vertical differences of the current column, the diagonal
+       differences and match mask of the previous column, and the bit
+       of the last row, as in "distance_bits_char". */
+
+    unsigned int pv;
+    unsigned int mv;
+    unsigned int d0_prev;
+    unsigned int eq_prev;
+    unsigned int last;
+
+    int score;
+    int max;
+    int osa;
+    int i;
+    int j;
+
+    if (len2 == 0) {
+	return len1;
+    }
+    for (j = 0; j < len2; j++) {
+	t.c[j] = word2[j];
+    }
+    for (; j < SHORT_MAX_LENGTH; j++) {
+	/* Unicode characters are never negative. */
+	t.c[j] = -1;
+    }
+#ifdef SHORT_SSE2
+    for (j = 0; j < 4; j++) {
+	t.v[j] = _mm_loadu_si128 ((const __m128i *) (t.c + 4 * j));
+    }
+#endif
+
+    max = tf->max_distance;
+    osa = tf->osa;
+    pv = ~ 0U;
+    mv = 0;
+    d0_prev = ~ 0U;
+    eq_prev = 0;
+    last = 1U << (len2 - 1);
+    score = len2;
+
+    for (i = 0; i < len1; i++) {
+	unsigned int eq;
+	unsigned int x;
+	unsigned int d0;
+	unsigned int ph;
+	unsigned int mh;
+
+	eq = short_mask (& t, word1[i]);
+	x = eq | mv;
+	d0 = (((x & pv) + pv) ^ pv) | x;
+	if (osa) {
+	    d0 |= ((~ d0_prev & eq) << 1) & eq_prev;
+	    d0_prev = d0;
+	    eq_prev = eq;
+	}
+	ph = mv | ~ (d0 | pv);
+	mh = pv & d0;
+	if (ph & last) {
+	    score++;
+	}
+	else if (mh & last) {
+	    score--;
+	}
+	ph = (ph << 1) | 1;
+	mh = mh << 1;
+	pv = mh | ~ (d0 | ph);
+	mv = ph & d0;
+
+	if (max != NO_MAX_DISTANCE) {
+	    if (score - (len1 - i - 1) > max) {
+		return max + 1;
+	    }
+	}
+    }
+    return score;
+}
@@ -0,0 +1,4 @@
+#ifndef EDIT_DISTANCE_SHORT_H
+#define EDIT_DISTANCE_SHORT_H
+int distance_short_int (text_fuzzy_t * tf);
+#endif /* EDIT_DISTANCE_SHORT_H */
@@ -0,0 +1,522 @@
+/* Edit distances and alphabet checks of many bytes at once, using
+   SIMD instructions.
+
+   "distance_simd_batch" runs the bit-parallel algorithm of
+   "distance_bits_char" on several words at once, one word in each
+   64-bit lane of the vector registers, and "distance_simd_misses"
+   counts the bytes of a string which are not in the alphabet of the
+   search term, sixteen or thirty-two at a time.
+
+   The instruction set is chosen once, by "distance_simd_init", from
+   what the CPU supports. If there is no suitable instruction set, or
+   the compiler cannot generate it, the same things are done one word
+   or one byte at a time. */
+
+#include <stdlib.h>
+
+#include "config.h"
+#include "text-fuzzy.h"
+#include "edit-distance-bits.h"
+#include "edit-distance-simd.h"
+
+#if defined (__GNUC__) && (__GNUC__ >= 5 || defined (__clang__)) && \
+    (defined (__x86_64__) || defined (__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+#ifdef SIMD_X86
+
+/* The most lanes of "distance_simd_batch". */
+
+#define BATCH_MAX_LANES 8
+
+/* If there is a maximum distance, "distance_simd_batch" checks for
+   words which are over it at least this often. */
+
+#define BATCH_CHECK 32
+
+/* The state of "distance_simd_batch" while it is not in the vector
+   registers. */
+
+typedef struct batch {
+    text_fuzzy_t * tf;
+
+    /* The words, the offsets in "words" of the ones to compare, and
+       where to put their edit distances. */
+
+    const text_fuzzy_string_t * words;
+    const int * todo;
+    int n_todo;
+    int * distances;
+
+    /* The next entry of "todo" to put into a lane. */
+
+    int next;
+
+    /* The number of lanes in use. */
+
+    int n_lanes;
+
+    /* For each lane, the next character of its word, the increment
+       of that pointer after each character, which is zero for empty
+       lanes, the number of characters still to go, and the offset of
+       the word in "words", or -1 for empty lanes. */
+
+    const unsigned char * p[BATCH_MAX_LANES];
+    int inc[BATCH_MAX_LANES];
+    int remaining[BATCH_MAX_LANES];
+    int word[BATCH_MAX_LANES];
+
+    /* The vertical differences and score of each lane, as in
+       "distance_bits_char". */
+
+    text_fuzzy_bits_t pv[BATCH_MAX_LANES];
+    text_fuzzy_bits_t mv[BATCH_MAX_LANES];
+    long long score[BATCH_MAX_LANES];
+}
+batch_t;
+
+/* What empty lanes read. */
+
+static const unsigned char batch_nothing[1];
+
+/* Put the next word into lane "l" of "b", or empty the lane if there
+   are no more words. */
+
+static void
+batch_fill (batch_t * b, int l)
+{
+    while (b->next < b->n_todo) {
+	int w;
+
+	w = b->todo[b->next];
+	b->next++;
+	if (b->words[w].length == 0) {
+	    b->distances[w] = b->tf->text.length;
+	    continue;
+	}
+	b->p[l] = (const unsigned char *) b->words[w].text;
+	b->inc[l] = 1;
+	b->remaining[l] = b->words[w].length;
+	b->word[l] = w;
+	b->pv[l] = ~ (text_fuzzy_bits_t) 0;
+	b->mv[l] = 0;
+	b->score[l] = b->tf->text.length;
+	return;
+    }
+    b->p[l] = batch_nothing;
+    b->inc[l] = 0;
+    b->remaining[l] = 0;
+    b->word[l] = -1;
+}
+
+/* Return the number of characters which every lane in use can
+   process before a word finishes, or zero if every lane is empty. */
+
+static int
+batch_steps (batch_t * b)
+{
+    int steps;
+    int l;
+
+    steps = 0;
+    for (l = 0; l < b->n_lanes; l++) {
+	if (b->word[l] >= 0 && (steps == 0 || b->remaining[l] < steps)) {
+	    steps = b->remaining[l];
+	}
+    }
+    if (steps > BATCH_CHECK && b->tf->max_distance != NO_MAX_DISTANCE) {
+	steps = BATCH_CHECK;
+    }
+    return steps;
+}
+
+/* After "steps" characters, record the edit distances of the words
+   which have finished, or which cannot be within the maximum
+   distance, and refill their lanes. */
+
+static void
+batch_finish (batch_t * b, int steps)
+{
+    int max;
+    int l;
+
+    max = b->tf->max_distance;
+    for (l = 0; l < b->n_lanes; l++) {
+	if (b->word[l] < 0) {
+	    continue;
+	}
+	b->remaining[l] -= steps;
+	if (b->remaining[l] == 0) {
+	    b->distances[b->word[l]] = b->score[l];
+	    batch_fill (b, l);
+	}
+	else if (max != NO_MAX_DISTANCE &&
+		 b->score[l] - b->remaining[l] > max) {
+	    /* See "distance_bits_char". */
+	    b->distances[b->word[l]] = max + 1;
+	    batch_fill (b, l);
+	}
+    }
+}
+
+__attribute__ ((target ("avx2")))
+static void
+batch_avx2 (batch_t * b)
+{
+    const text_fuzzy_bits_t * peq;
+    __m128i shift;
+    __m256i ones;
+    __m256i one;
+    int steps;
+
+    peq = b->tf->peq;
+    shift = _mm_cvtsi32_si128 (b->tf->text.length - 1);
+    ones = _mm256_set1_epi64x (-1);
+    one = _mm256_set1_epi64x (1);
+    while ((steps = batch_steps (b)) > 0) {
+	const unsigned char * p0 = b->p[0];
+	const unsigned char * p1 = b->p[1];
+	const unsigned char * p2 = b->p[2];
+	const unsigned char * p3 = b->p[3];
+	__m256i pv;
+	__m256i mv;
+	__m256i score;
+	int s;
+
+	pv = _mm256_loadu_si256 ((const __m256i *) b->pv);
+	mv = _mm256_loadu_si256 ((const __m256i *) b->mv);
+	score = _mm256_loadu_si256 ((const __m256i *) b->score);
+	for (s = 0; s < steps; s++) {
+	    __m256i eq;
+	    __m256i x;
+	    __m256i d0;
+	    __m256i ph;
+	    __m256i mh;
+
+	    eq = _mm256_set_epi64x (peq[* p3], peq[* p2], peq[* p1], peq[* p0]);
+	    p0 += b->inc[0];
+	    p1 += b->inc[1];
+	    p2 += b->inc[2];
+	    p3 += b->inc[3];
+	    x = _mm256_or_si256 (eq, mv);
+	    d0 = _mm256_or_si256 (_mm256_xor_si256 (_mm256_add_epi64 (_mm256_and_si256 (x, pv), pv), pv), x);
+	    ph = _mm256_or_si256 (mv, _mm256_andnot_si256 (_mm256_or_si256 (d0, pv), ones));
+	    mh = _mm256_and_si256 (pv, d0);
+	    score = _mm256_add_epi64 (score, _mm256_and_si256 (_mm256_srl_epi64 (ph, shift), one));
+	    score = _mm256_sub_epi64 (score, _mm256_and_si256 (_mm256_srl_epi64 (mh, shift), one));
+	    ph = _mm256_or_si256 (_mm256_slli_epi64 (ph, 1), one);
+	    mh = _mm256_slli_epi64 (mh, 1);
+	    pv = _mm256_or_si256 (mh, _mm256_andnot_si256 (_mm256_or_si256 (d0, ph), ones));
+	    mv = _mm256_and_si256 (ph, d0);
+	}
+	_mm256_storeu_si256 ((__m256i *) b->pv, pv);
+	_mm256_storeu_si256 ((__m256i *) b->mv, mv);
+	_mm256_storeu_si256 ((__m256i *) b->score, score);
+	b->p[0] = p0;
+	b->p[1] = p1;
+	b->p[2] = p2;
+	b->p[3] = p3;
+	batch_finish (b, steps);
+    }
+}
+
+__attribute__ ((target ("avx512f")))
+static void
+batch_avx512 (batch_t * b)
+{
+    const text_fuzzy_bits_t * peq;
+    __m128i shift;
+    __m512i ones;
+    __m512i one;
+    int steps;
+
+    peq = b->tf->peq;
+    shift = _mm_cvtsi32_si128 (b->tf->text.length - 1);
+    ones = _mm512_set1_epi64 (-1);
+    one = _mm512_set1_epi64 (1);
+    while ((steps = batch_steps (b)) > 0) {
+	const unsigned char * p0 = b->p[0];
+	const unsigned char * p1 = b->p[1];
+	const unsigned char * p2 = b->p[2];
+	const unsigned char * p3 = b->p[3];
+	const unsigned char * p4 = b->p[4];
+	const unsigned char * p5 = b->p[5];
+	const unsigned char * p6 = b->p[6];
+	const unsigned char * p7 = b->p[7];
+	__m512i pv;
+	__m512i mv;
+	__m512i score;
+	int s;
+
+	pv = _mm512_loadu_si512 ((const void *) b->pv);
+	mv = _mm512_loadu_si512 ((const void *) b->mv);
+	score = _mm512_loadu_si512 ((const void *) b->score);
+	for (s = 0; s < steps; s++) {
+	    __m512i eq;
+	    __m512i x;
+	    __m512i d0;
+	    __m512i ph;
+	    __m512i mh;
+
+	    eq = _mm512_set_epi64 (peq[* p7], peq[* p6], peq[* p5], peq[* p4],
+				   peq[* p3], peq[* p2], peq[* p1], peq[* p0]);
+	    p0 += b->inc[0];
+	    p1 += b->inc[1];
+	    p2 += b->inc[2];
+	    p3 += b->inc[3];
+	    p4 += b->inc[4];
+	    p5 += b->inc[5];
+	    p6 += b->inc[6];
+	    p7 += b->inc[7];
+	    x = _mm512_or_si512 (eq, mv);
+	    d0 = _mm512_or_si512 (_mm512_xor_si512 (_mm512_add_epi64 (_mm512_and_si512 (x, pv), pv), pv), x);
+	    ph = _mm512_or_si512 (mv, _mm512_andnot_si512 (_mm512_or_si512 (d0, pv), ones));
+	    mh = _mm512_and_si512 (pv, d0);
+	    score = _mm512_add_epi64 (score, _mm512_and_si512 (_mm512_srl_epi64 (ph, shift), one));
+	    score = _mm512_sub_epi64 (score, _mm512_and_si512 (_mm512_srl_epi64 (mh, shift), one));
+	    ph = _mm512_or_si512 (_mm512_slli_epi64 (ph, 1), one);
+	    mh = _mm512_slli_epi64 (mh, 1);
+	    pv = _mm512_or_si512 (mh, _mm512_andnot_si512 (_mm512_or_si512 (d0, ph), ones));
+	    mv = _mm512_and_si512 (ph, d0);
+	}
+	_mm512_storeu_si512 ((void *) b->pv, pv);
+	_mm512_storeu_si512 ((void *) b->mv, mv);
+	_mm512_storeu_si512 ((void *) b->score, score);
+	b->p[0] = p0;
+	b->p[1] = p1;
+	b->p[2] = p2;
+	b->p[3] = p3;
+	b->p[4] = p4;
+	b->p[5] = p5;
+	b->p[6] = p6;
+	b->p[7] = p7;
+	batch_finish (b, steps);
+    }
+}
+
+/* The number of lanes for "distance_simd_batch", or zero if it
+   cannot use SIMD instructions. */
+
+static int batch_lanes;
+
+#endif /* def SIMD_X86 */
+
+/* The number of the "n" bytes of "s" which are not in "mask", one at a
+   time. */
+
+static int
+misses_bytes (const unsigned char * mask, const unsigned char * s, int n)
+{
+    int misses;
+    int i;
+
+    misses = 0;
+    for (i = 0; i < n; i++) {
+	misses += ! TEXT_FUZZY_ALPHABET_BIT (mask, s[i]);
+    }
+    return misses;
+}
+
+#ifdef SIMD_X86
+
+/* The bit of a byte of "alphabet_mask" for each value of bits 4 to 6
+   of a byte, for looking up with a shuffle. */
+
+#define MISSES_BITS 1, 2, 4, 8, 16, 32, 64, (char) 128,	\
+	0, 0, 0, 0, 0, 0, 0, 0
+
+typedef int (* misses_t) (const unsigned char * mask,
+			  const unsigned char * s, int n);
+
+__attribute__ ((target ("ssse3")))
+static int
+misses_ssse3 (const unsigned char * mask, const unsigned char * s, int n)
+{
+    __m128i t0;
+    __m128i t1;
+    __m128i bits;
+    __m128i low;
+    __m128i top;
+    __m128i seven;
+    __m128i zero;
+    int misses;
+    int i;
+
+    t0 = _mm_loadu_si128 ((const __m128i *) mask);
+    t1 = _mm_loadu_si128 ((const __m128i *) (mask + 16));
+    bits = _mm_setr_epi8 (MISSES_BITS);
+    low = _mm_set1_epi8 ((char) 0x8F);
+    top = _mm_set1_epi8 ((char) 0x80);
+    seven = _mm_set1_epi8 (7);
+    zero = _mm_setzero_si128 ();
+    misses = 0;
+    for (i = 0; i + 16 <= n; i += 16) {
+	__m128i x;
+	__m128i in;
+
+	/* Bytes below 0x80 look up their low nibble in "t0", and the
+	   others in "t1", since a shuffle gives zero for an index
+	   with the top bit set. The high nibble then picks the bit of
+	   the byte from the mask. */
+
+	x = _mm_loadu_si128 ((const __m128i *) (s + i));
+	in = _mm_or_si128 (_mm_shuffle_epi8 (t0, _mm_and_si128 (x, low)),
+			   _mm_shuffle_epi8 (t1, _mm_and_si128
+					     (_mm_xor_si128 (x, top), low)));
+	in = _mm_and_si128 (in, _mm_shuffle_epi8
+			    (bits, _mm_and_si128 (_mm_srli_epi16 (x, 4),
+						  seven)));
+	misses += __builtin_popcount
+	    (_mm_movemask_epi8 (_mm_cmpeq_epi8 (in, zero)));
+    }
+    return misses + misses_bytes (mask, s + i, n - i);
+}
+
+__attribute__ ((target ("avx2,popcnt")))
+static int
+misses_avx2 (const unsigned char * mask, const unsigned char * s, int n)
+{
+    __m256i t0;
+    __m256i t1;
+    __m256i bits;
+    __m256i low;
+    __m256i top;
+    __m256i seven;
+    __m256i zero;
+    int misses;
+    int i;
+
+    t0 = _mm256_broadcastsi128_si256
+	(_mm_loadu_si128 ((const __m128i *) mask));
+    t1 = _mm256_broadcastsi128_si256
+	(_mm_loadu_si128 ((const __m128i *) (mask + 16)));
+    bits = _mm256_setr_epi8 (MISSES_BITS, MISSES_BITS);
+    low = _mm256_set1_epi8 ((char) 0x8F);
+    top = _mm256_set1_epi8 ((char) 0x80);
+    seven = _mm256_set1_epi8 (7);
+    zero = _mm256_setzero_si256 ();
+    misses = 0;
+    for (i = 0; i + 32 <= n; i += 32) {
+	__m256i x;
+	__m256i in;
+
+	/* See "misses_ssse3". */
+
+	x = _mm256_loadu_si256 ((const __m256i *) (s + i));
+	in = _mm256_or_si256
+	    (_mm256_shuffle_epi8 (t0, _mm256_and_si256 (x, low)),
+	     _mm256_shuffle_epi8 (t1, _mm256_and_si256
+				  (_mm256_xor_si256 (x, top), low)));
+	in = _mm256_and_si256 (in, _mm256_shuffle_epi8
+			       (bits, _mm256_and_si256
+				(_mm256_srli_epi16 (x, 4), seven)));
+	misses += __builtin_popcount
+	    ((unsigned int) _mm256_movemask_epi8
+	     (_mm256_cmpeq_epi8 (in, zero)));
+    }
+    return misses + misses_bytes (mask, s + i, n - i);
+}
+
+/* The function for "distance_simd_misses", or zero if there are no
+   suitable instructions. */
+
+static misses_t misses;
+
+#endif /* def SIMD_X86 */
+
+/* Choose the SIMD instruction set from what the CPU supports. This is
+   called once when the module is loaded. */
+
+void distance_simd_init (void)
+{
+#ifdef SIMD_X86
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx512f")) {
+	batch_lanes = 8;
+    }
+    else if (__builtin_cpu_supports ("avx2")) {
+	batch_lanes = 4;
+    }
+    if (__builtin_cpu_supports ("avx2") &&
+	__builtin_cpu_supports ("popcnt")) {
+	misses = misses_avx2;
+    }
+    else if (__builtin_cpu_supports ("ssse3")) {
+	misses = misses_ssse3;
+    }
+#endif /* def SIMD_X86 */
+}
+
+/* Return the number of words which "distance_simd_batch" compares at
+   once, or zero if it cannot use SIMD instructions, in which case
+   there is no point in using it. */
+
+int distance_simd_batch_lanes (void)
+{
+#ifdef SIMD_X86
+    return batch_lanes;
+#else
+    return 0;
+#endif /* def SIMD_X86 */
+}
+
+/* Compute the Levenshtein edit distances between "tf->text" and the
+   byte strings "words[todo[i]]" for "i" from 0 to "n_todo - 1", and
+   put them into "distances[todo[i]]". The match masks of "tf->text"
+   must be in "tf->peq". As the words finish, or are found to be over
+   the maximum distance, their lanes are refilled with the next
+   words. If there is a maximum distance, edit distances over it are
+   some value greater than the maximum distance, as in
+   "distance_bits_char". */
+
+void distance_simd_batch (text_fuzzy_t * tf, const text_fuzzy_string_t * words,
+			  const int * todo, int n_todo, int * distances)
+{
+    int i;
+
+#ifdef SIMD_X86
+    if (batch_lanes > 0) {
+	batch_t b;
+	int l;
+
+	b.tf = tf;
+	b.words = words;
+	b.todo = todo;
+	b.n_todo = n_todo;
+	b.distances = distances;
+	b.next = 0;
+	b.n_lanes = batch_lanes;
+	for (l = 0; l < b.n_lanes; l++) {
+	    batch_fill (& b, l);
+	}
+	if (b.n_lanes == 8) {
+	    batch_avx512 (& b);
+	}
+	else {
+	    batch_avx2 (& b);
+	}
+	return;
+    }
+#endif /* def SIMD_X86 */
+    for (i = 0; i < n_todo; i++) {
+	tf->b.text = words[todo[i]].text;
+	tf->b.length = words[todo[i]].length;
+	distances[todo[i]] = distance_bits_char (tf);
+    }
+}
+
+/* The number of the "n" bytes of "s" which are not in the alphabet
+   mask "mask", as made by "text_fuzzy_generate_alphabet". */
+
+int distance_simd_misses (const unsigned char * mask,
+			  const unsigned char * s, int n)
+{
+#ifdef SIMD_X86
+    if (misses) {
+	return misses (mask, s, n);
+    }
+#endif /* def SIMD_X86 */
+    return misses_bytes (mask, s, n);
+}
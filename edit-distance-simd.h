@@ -0,0 +1,7 @@
+#ifndef EDIT_DISTANCE_SIMD_H
+#define EDIT_DISTANCE_SIMD_H
+void distance_simd_init (void);
+int distance_simd_batch_lanes (void);
+void distance_simd_batch (text_fuzzy_t * tf, const text_fuzzy_string_t * words, const int * todo, int n_todo, int * distances);
+int distance_simd_misses (const unsigned char * mask, const unsigned char * s, int n);
+#endif /* EDIT_DISTANCE_SIMD_H */
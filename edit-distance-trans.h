@@ -0,0 +1,261 @@
+/* The body of the Damerau-Levenshtein and optimal string alignment
+   distances of "edit-distance-char-trans.c" and
+   "edit-distance-int-trans.c", which include this once for each
+   type of the cells of the matrix. Before each inclusion, define
+
+   TRANS_FUNCTION, the name of the function,
+   CELL_T, the type of the cells of the matrix,
+
+   and, once for each file,
+
+   TRANS_CHAR_T, the type of the characters of the strings,
+   TRANS_TEXT and TRANS_LENGTH, the names of the characters and the
+   length in "text_fuzzy_string_t",
+   TRANS_KEYS, if the characters are looked up in the hash table of
+   the search term with "text_fuzzy_char_row" to index "last_row",
+   rather than indexing it themselves.
+
+   This undefines TRANS_FUNCTION and CELL_T at the end. */
+
+static int
+TRANS_FUNCTION (text_fuzzy_t * tf)
+{
+    const TRANS_CHAR_T * word1 = (const TRANS_CHAR_T *) tf->b.TRANS_TEXT;
+    int len1 = tf->b.TRANS_LENGTH;
+    const TRANS_CHAR_T * word2 = (const TRANS_CHAR_T *) tf->text.TRANS_TEXT;
+    int len2 = tf->text.TRANS_LENGTH;
+
+    /* The number of entries in "last_row", and the number of "int"s
+       of memory before the cells. */
+
+#ifdef TRANS_KEYS
+    int n_keys = tf->masks.n_chars + 1;
+    int n_ints = n_keys + len1 + len2 + 2;
+#else /* TRANS_KEYS */
+    int n_keys = 0x100;
+    int n_ints = n_keys;
+#endif /* TRANS_KEYS */
+
+    /* The memory for the arrays below, from "tf->workspace". */
+
+    void * mem;
+    CELL_T * rows[3];
+    int * last_row;
+
+    /* The indices into "last_row" of the characters of "word1" and
+       "word2". */
+
+#ifdef TRANS_KEYS
+    int * key1;
+    int * key2;
+#define KEY1(i) key1[i]
+#define KEY2(j) key2[j]
+#else /* TRANS_KEYS */
+#define KEY1(i) word1[i]
+#define KEY2(j) word2[j]
+#endif /* TRANS_KEYS */
+
+    /* The current row, the previous row, and the row before that, of
+       the dynamic programming matrix. These are offset by one so that
+       "r[-1]" may be used. */
+
+    CELL_T * r;
+    CELL_T * r1;
+    CELL_T * r2;
+
+    /* For each column "j", the value of the cell of the previous row
+       and two columns before, at the last row where the column
+       matched. */
+
+    CELL_T * first_row;
+
+    /* The largest distance we care about, and a value bigger than it
+       which marks cells we did not compute. */
+
+    int max;
+    int big;
+    int osa;
+    int i;
+    int j;
+    int d;
+
+    if (len1 == 0) {
+	return len2;
+    }
+    if (len2 == 0) {
+	return len1;
+    }
+    max = tf->max_distance;
+    if (max == NO_MAX_DISTANCE || max > len1 + len2) {
+	max = len1 + len2;
+    }
+    big = max + 1;
+    osa = tf->osa;
+    if (abs (len1 - len2) > max) {
+	return big;
+    }
+
+    /* The "int" arrays go first so that the cells are aligned. */
+
+    if (text_fuzzy_workspace (tf, n_ints * sizeof (int) +
+			      4 * (len2 + 3) * sizeof (CELL_T), & mem)
+	!= text_fuzzy_status_ok) {
+	/* The error handler has already been called. */
+	return big;
+    }
+    last_row = mem;
+    rows[0] = (CELL_T *) (last_row + n_ints);
+    for (i = 1; i < 3; i++) {
+	rows[i] = rows[i - 1] + len2 + 3;
+    }
+
+#ifdef TRANS_KEYS
+    key1 = last_row + n_keys;
+    key2 = key1 + len1 + 1;
+    for (i = 0; i < len1; i++) {
+	key1[i] = text_fuzzy_char_row (& tf->masks, word1[i]);
+    }
+    for (j = 0; j < len2; j++) {
+	key2[j] = text_fuzzy_char_row (& tf->masks, word2[j]);
+    }
+#endif /* TRANS_KEYS */
+
+    r2 = rows[0] + 1;
+    r1 = rows[1] + 1;
+    r = rows[2] + 1;
+    first_row = rows[2] + len2 + 3 + 1;
+    for (j = -1; j <= len2 + 1; j++) {
+	r2[j] = big;
+	r1[j] = big;
+	r[j] = big;
+	first_row[j] = big;
+    }
+
+    /* Row zero of the matrix. Row minus one, in "r2", is all
+       "big". */
+
+    for (j = 0; j <= len2; j++) {
+	r1[j] = j;
+    }
+
+    /* "last_row[c]" is the last row of "word1" containing "c", or
+       zero if "c" has not occurred yet. */
+
+    for (j = 0; j < n_keys; j++) {
+	last_row[j] = 0;
+    }
+
+    d = -1;
+    for (i = 1; i <= len1; i++) {
+	/* The first and last columns to compute. */
+	int lo;
+	int hi;
+	/* The last column of this row which matched "word1[i-1]", or
+	   zero. */
+	int l;
+	/* The value two rows above and one column before "l". */
+	int t;
+	/* The smallest value in this row. */
+	int row_min;
+	CELL_T * swap;
+
+	lo = 1;
+	if (i - max > lo) {
+	    lo = i - max;
+	}
+	hi = len2;
+	if (i + max < hi) {
+	    hi = i + max;
+	}
+	r[0] = i;
+	if (lo > 1) {
+	    r[lo - 1] = big;
+	}
+	if (hi < len2) {
+	    r[hi + 1] = big;
+	}
+	l = 0;
+	t = big;
+	row_min = big;
+	for (j = lo; j <= hi; j++) {
+	    int value;
+
+	    value = r1[j - 1];
+	    if (word1[i - 1] != word2[j - 1]) {
+		/* The last row of "word1" containing "word2[j-1]". */
+		int k;
+
+		value++;
+		k = last_row[KEY2 (j - 1)];
+		if (osa) {
+		    /* The optimal string alignment distance only allows
+		       swapping two adjacent characters. */
+		    if (i > 1 && j > 1 &&
+			word1[i - 1] == word2[j - 2] &&
+			word1[i - 2] == word2[j - 1]) {
+			if (r2[j - 2] + 1 < value) {
+			    value = r2[j - 2] + 1;
+			}
+		    }
+		}
+		else if (k > 0 && l > 0) {
+		    /* By Zhao and Sahni's theorem, a transposition needs
+		       only be considered if either the match in this
+		       row or the match in this column is adjacent. */
+		    if (j - l == 1) {
+			if (first_row[j] + i - k < value) {
+			    value = first_row[j] + i - k;
+			}
+		    }
+		    else if (i - k == 1) {
+			if (t + j - l < value) {
+			    value = t + j - l;
+			}
+		    }
+		}
+	    }
+	    else {
+		l = j;
+		first_row[j] = r1[j - 2];
+		t = r2[j - 1];
+	    }
+	    if (r[j - 1] + 1 < value) {
+		value = r[j - 1] + 1;
+	    }
+	    if (r1[j] + 1 < value) {
+		value = r1[j] + 1;
+	    }
+	    if (value > big) {
+		/* Cells next to the band may exceed "big", but their
+		   exact values do not matter, and this keeps them
+		   within the range of "CELL_T". */
+		value = big;
+	    }
+	    r[j] = value;
+	    if (value < row_min) {
+		row_min = value;
+	    }
+	}
+	if (row_min > max) {
+	    /* Every cell in this row is over the maximum, so the
+	       distance is too. */
+	    d = big;
+	    break;
+	}
+	last_row[KEY1 (i - 1)] = i;
+	swap = r2;
+	r2 = r1;
+	r1 = r;
+	r = swap;
+    }
+    if (d == -1) {
+	d = r1[len2];
+    }
+
+    return d;
+}
+
+#undef KEY1
+#undef KEY2
+#undef TRANS_FUNCTION
+#undef CELL_T
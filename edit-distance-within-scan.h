@@ -0,0 +1,142 @@
+/* The scans of "edit-distance-within.c" for a maximum distance of
+   zero, one or two, which it includes once for byte strings and once
+   for Unicode strings. Before each inclusion, define
+
+   WITHIN_CHAR_T, the type of the characters of the strings,
+   WITHIN_COMMON, the name of the function which gives the number of
+   characters which are the same at the start of both strings,
+   WITHIN0, WITHIN1 and WITHIN2, the names of the functions for a
+   maximum distance of zero, one and two.
+
+   This undefines all of them at the end. */
+
+/* Is "a" from "i" to "len1" the same as "b" from "j" to "len2"? This
+   is the edit distance if the maximum distance is zero. */
+
+static int
+WITHIN0 (const WITHIN_CHAR_T * a, int i, int len1,
+	 const WITHIN_CHAR_T * b, int j, int len2)
+{
+    if (len1 - i != len2 - j) {
+	return 1;
+    }
+    if (memcmp (a + i, b + j, (len1 - i) * sizeof (WITHIN_CHAR_T)) != 0) {
+	return 1;
+    }
+    return 0;
+}
+
+/* The edit distance between "a" from "i" to "len1" and "b" from "j"
+   to "len2", if it is at most one, or two otherwise. */
+
+static int
+WITHIN1 (const WITHIN_CHAR_T * a, int i, int len1,
+	 const WITHIN_CHAR_T * b, int j, int len2, int trans)
+{
+    int diff;
+    int d;
+
+    diff = (len1 - i) - (len2 - j);
+    if (abs (diff) > 1) {
+	return 2;
+    }
+    d = WITHIN_COMMON (a, i, len1, b, j, len2);
+    i += d;
+    j += d;
+    if (i == len1 || j == len2) {
+	/* The length check above leaves at most one character. */
+	return abs (diff);
+    }
+    if (diff == 1) {
+	return 1 + WITHIN0 (a, i + 1, len1, b, j, len2);
+    }
+    if (diff == -1) {
+	return 1 + WITHIN0 (a, i, len1, b, j + 1, len2);
+    }
+    if (WITHIN0 (a, i + 1, len1, b, j + 1, len2) == 0) {
+	return 1;
+    }
+    if (trans && i + 1 < len1 &&
+	a[i] == b[j + 1] && a[i + 1] == b[j] &&
+	WITHIN0 (a, i + 2, len1, b, j + 2, len2) == 0) {
+	return 1;
+    }
+    return 2;
+}
+
+/* The edit distance between "a" from "i" to "len1" and "b" from "j"
+   to "len2", if it is at most two, or three otherwise. */
+
+static int
+WITHIN2 (const WITHIN_CHAR_T * a, int i, int len1,
+	 const WITHIN_CHAR_T * b, int j, int len2, int trans)
+{
+    int best;
+    int d;
+
+    if (abs ((len1 - i) - (len2 - j)) > 2) {
+	return 3;
+    }
+    d = WITHIN_COMMON (a, i, len1, b, j, len2);
+    i += d;
+    j += d;
+    if (i == len1) {
+	return len2 - j;
+    }
+    if (j == len2) {
+	return len1 - i;
+    }
+
+    /* Substitute, delete and insert. */
+
+    best = 1 + WITHIN1 (a, i + 1, len1, b, j + 1, len2, trans);
+    if (best > 1) {
+	d = 1 + WITHIN1 (a, i + 1, len1, b, j, len2, trans);
+	if (d < best) {
+	    best = d;
+	}
+    }
+    if (best > 1) {
+	d = 1 + WITHIN1 (a, i, len1, b, j + 1, len2, trans);
+	if (d < best) {
+	    best = d;
+	}
+    }
+    if (! trans || best == 1) {
+	return best;
+    }
+
+    /* Transpose two adjacent characters. */
+
+    if (i + 1 < len1 && j + 1 < len2 &&
+	a[i] == b[j + 1] && a[i + 1] == b[j]) {
+	d = 1 + WITHIN1 (a, i + 2, len1, b, j + 2, len2, trans);
+	if (d < best) {
+	    best = d;
+	}
+    }
+
+    /* The Damerau-Levenshtein distance also allows a transposition of
+       two characters with one character inserted or deleted between
+       them, which costs two. */
+
+    if (trans == 1 && best > 2) {
+	if (i + 1 < len1 && j + 2 < len2 &&
+	    a[i] == b[j + 2] && a[i + 1] == b[j] &&
+	    WITHIN0 (a, i + 2, len1, b, j + 3, len2) == 0) {
+	    best = 2;
+	}
+	else if (i + 2 < len1 && j + 1 < len2 &&
+		 a[i] == b[j + 1] && a[i + 2] == b[j] &&
+		 WITHIN0 (a, i + 3, len1, b, j + 2, len2) == 0) {
+	    best = 2;
+	}
+    }
+    return best;
+}
+
+#undef WITHIN_CHAR_T
+#undef WITHIN_COMMON
+#undef WITHIN0
+#undef WITHIN1
+#undef WITHIN2
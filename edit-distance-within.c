@@ -0,0 +1,151 @@
+/* Edit distances for maximum distances of zero, one and two.
+
+   These are the most common maximum distances, for example in spell
+   checking, and need no matrix. After skipping the characters which
+   are the same at the start of both strings, the first characters
+   differ, so any way of editing one string into the other must begin
+   by editing them, either by substituting one for the other,
+   deleting one, inserting one, or transposing it with its
+   neighbour. Each of these leaves a shorter pair of strings, which
+   must be within one edit fewer of each other.
+
+   There is a separate function for each maximum distance and each
+   kind of string, so that each one is a few fixed linear scans, and
+   "text_fuzzy_compare_single" picks one from a table. The functions
+   for byte strings and Unicode strings are made from the same code in
+   "edit-distance-within-scan.h", and differ only in the scan of the
+   common prefix.
+
+   There is no function for a maximum distance of three, so
+   WITHIN_MAX_DISTANCE is two. Each extra edit multiplies the number
+   of ways to try by three or four, so a function for three would
+   scan the strings dozens of times on strings which are not within
+   the distance. The Damerau-Levenshtein distance would also need
+   more cases for transpositions with characters inserted between
+   them. A maximum distance of three is left to the diagonal and
+   bit-parallel algorithms, which go through the strings once,
+   whatever the maximum distance, and on short strings take about as
+   long as the function for two.
+
+   The "trans" arguments are zero for the Levenshtein distance, one
+   for the Damerau-Levenshtein distance, or two for the optimal string
+   alignment distance. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "text-fuzzy.h"
+#include "edit-distance-diagonal.h"
+#include "edit-distance-within.h"
+
+/* The kind of transpositions "tf" allows, for the "trans"
+   arguments. */
+
+static int
+trans_type (const text_fuzzy_t * tf)
+{
+    if (! tf->transpositions_ok) {
+	return 0;
+    }
+    if (tf->osa) {
+	return 2;
+    }
+    return 1;
+}
+
+/* The number of characters which are the same at the start of "a"
+   from "i" to "len1" and "b" from "j" to "len2". */
+
+static int
+common_char (const unsigned char * a, int i, int len1,
+	     const unsigned char * b, int j, int len2)
+{
+    int n;
+
+    n = len1 - i;
+    if (len2 - j < n) {
+	n = len2 - j;
+    }
+    return diagonal_common_prefix (a + i, b + j, n);
+}
+
+/* The scans for byte strings. */
+
+#define WITHIN_CHAR_T unsigned char
+#define WITHIN_COMMON common_char
+#define WITHIN0 within0_char
+#define WITHIN1 within1_char
+#define WITHIN2 within2_char
+#include "edit-distance-within-scan.h"
+
+/* Compute the edit distance between "tf->text" and "tf->b" for
+   byte strings, with a maximum distance of zero, one or two. */
+
+int distance_within0_char (text_fuzzy_t * tf)
+{
+    return within0_char ((const unsigned char *) tf->b.text, 0, tf->b.length,
+			 (const unsigned char *) tf->text.text, 0, tf->text.length);
+}
+
+int distance_within1_char (text_fuzzy_t * tf)
+{
+    return within1_char ((const unsigned char *) tf->b.text, 0, tf->b.length,
+			 (const unsigned char *) tf->text.text, 0, tf->text.length,
+			 trans_type (tf));
+}
+
+int distance_within2_char (text_fuzzy_t * tf)
+{
+    return within2_char ((const unsigned char *) tf->b.text, 0, tf->b.length,
+			 (const unsigned char *) tf->text.text, 0, tf->text.length,
+			 trans_type (tf));
+}
+
+/* The number of characters which are the same at the start of "a"
+   from "i" to "len1" and "b" from "j" to "len2". */
+
+static int
+common_int (const int * a, int i, int len1,
+	    const int * b, int j, int len2)
+{
+    int n;
+
+    n = 0;
+    while (i + n < len1 && j + n < len2 && a[i + n] == b[j + n]) {
+	n++;
+    }
+    return n;
+}
+
+/* The scans for Unicode strings. */
+
+#define WITHIN_CHAR_T int
+#define WITHIN_COMMON common_int
+#define WITHIN0 within0_int
+#define WITHIN1 within1_int
+#define WITHIN2 within2_int
+#include "edit-distance-within-scan.h"
+
+/* Compute the edit distance between "tf->text" and "tf->b" for
+   Unicode strings, with a maximum distance of zero, one or two. */
+
+int distance_within0_int (text_fuzzy_t * tf)
+{
+    return within0_int (tf->b.unicode, 0, tf->b.ulength,
+			tf->text.unicode, 0, tf->text.ulength);
+}
+
+int distance_within1_int (text_fuzzy_t * tf)
+{
+    return within1_int (tf->b.unicode, 0, tf->b.ulength,
+			tf->text.unicode, 0, tf->text.ulength,
+			trans_type (tf));
+}
+
+int distance_within2_int (text_fuzzy_t * tf)
+{
+    return within2_int (tf->b.unicode, 0, tf->b.ulength,
+			tf->text.unicode, 0, tf->text.ulength,
+			trans_type (tf));
+}
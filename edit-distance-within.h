@@ -0,0 +1,9 @@
+#ifndef EDIT_DISTANCE_WITHIN_H
+#define EDIT_DISTANCE_WITHIN_H
+int distance_within0_char (text_fuzzy_t * tf);
+int distance_within1_char (text_fuzzy_t * tf);
+int distance_within2_char (text_fuzzy_t * tf);
+int distance_within0_int (text_fuzzy_t * tf);
+int distance_within1_int (text_fuzzy_t * tf);
+int distance_within2_int (text_fuzzy_t * tf);
+#endif /* EDIT_DISTANCE_WITHIN_H */
@@ -45,8 +45,13 @@ my @uwords = qw/
 サイエンスはV
 /;
 my $nearest4 = $tf4->nearest (\@uwords);
-is ($nearest4, 1);
+# The last two words are both at a distance of two, and "nearest"
+# returns the last one found.
+is ($nearest4, 2);
 is ($tf4->last_distance (), 2);
+my $tf4max = Text::Fuzzy->new ('サインはV', max => 2);
+is ($tf4max->distance ('サイエンスはV'), 2,
+    "Two characters not in the search term, within the maximum");
 
 $tf->set_max_distance ();
 my $md = $tf->get_max_distance ();
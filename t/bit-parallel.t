@@ -0,0 +1,233 @@
+# Check that the bit-parallel edit distance gives the same results as
+# the dynamic programming algorithm, with and without a maximum
+# distance.
+
+use warnings;
+use strict;
+use Test::More;
+use Text::Fuzzy;
+
+srand (19690720);
+
+# Words up to 64 bytes long use the bit-parallel algorithm.
+
+for my $length (0, 1, 2, 7, 31, 32, 33, 63, 64) {
+    for (1..20) {
+	my $word = random_word ($length, 'abcd');
+	my $other = random_word (int (rand (70)), 'abcde');
+	my $expect = levenshtein ($word, $other);
+	my $tf = Text::Fuzzy->new ($word);
+	is ($tf->distance ($other), $expect,
+	    "distance '$word' '$other'");
+	for my $max (0, 1, 3, 10) {
+	    my $tfmax = Text::Fuzzy->new ($word, max => $max);
+	    my $got = $tfmax->distance ($other);
+	    if ($expect <= $max) {
+		is ($got, $expect, "distance with max $max");
+	    }
+	    else {
+		is ($got, $max + 1, "over max $max");
+	    }
+	}
+    }
+}
+
+# Longer words use the blocked bit-parallel algorithm, which only
+# computes the blocks within the band of the maximum distance.
+
+for my $length (65, 127, 128, 129, 200, 400) {
+    for (1..10) {
+	my $word = random_word ($length, 'abcd');
+	my $other = mutate ($word, int (rand (40)));
+	check_all ($word, $other);
+    }
+}
+
+# Unicode words use the blocked bit-parallel algorithm at all
+# lengths. The Unicode alphabet filter is switched off so that every
+# word reaches the edit distance algorithm.
+
+use utf8;
+for my $length (0, 1, 5, 63, 64, 65, 150, 300) {
+    for (1..10) {
+	my $word = random_word ($length, 'あいうえおa');
+	my $other = mutate ($word, int (rand (30)), 'あいうえおかa');
+	check_all ($word, $other, 1);
+    }
+}
+no utf8;
+
+# Search terms with many different characters, which fill the hash
+# table of match masks and make the lookups probe past collisions.
+
+my $kanji = join '', map {chr ($_)} 0x4E00..0x4E00 + 199;
+for my $length (20, 70, 200) {
+    for (1..5) {
+	my $word = random_word ($length, $kanji);
+	my $other = mutate ($word, int (rand (30)), $kanji . 'a');
+	check_all ($word, $other, 1);
+    }
+}
+
+# A search term with too many different characters for all of their
+# match masks only makes masks for the characters in both strings.
+# Since the characters of the search term are all different,
+# substituting new characters and deleting characters each cost one.
+
+my @long = map {chr ($_)} 0x4E00..0x4E00 + 3999;
+my @edited = @long;
+for my $i (reverse 0..29) {
+    if ($i % 2) {
+	splice @edited, 100 * $i + 50, 1;
+    }
+    else {
+	$edited[100 * $i + 50] = chr (0x3041 + $i);
+    }
+}
+my $long = join '', @long;
+my $edited = join '', @edited;
+for my $trans (0, 'osa') {
+    my $tf = Text::Fuzzy->new ($long, trans => $trans);
+    is ($tf->distance ($edited), 30, "many different characters, trans $trans");
+    $tf->set_max_distance (40);
+    is ($tf->distance ($edited), 30, "many different characters with max");
+    $tf->set_max_distance (20);
+    is ($tf->distance ($edited), 21, "many different characters over max");
+}
+
+# Check "nearest" finds the same word as a brute-force search.
+
+for (1..20) {
+    my $word = random_word (1 + int (rand (20)), 'abc');
+    my @words = map {random_word (int (rand (25)), 'abc')} 1..50;
+    my $tf = Text::Fuzzy->new ($word);
+    my @nearest = $tf->nearest (\@words);
+    my $min = levenshtein ($word, $words[$nearest[0]]);
+    my @expect = grep {levenshtein ($word, $words[$_]) == $min} 0..$#words;
+    is_deeply (\@nearest, \@expect, "nearest to $word");
+    is ($tf->last_distance (), $min, "last distance to $word");
+}
+
+# Long lists are compared several words at a time. Check that the
+# results are the same as comparing the words one by one, including
+# when words marked as Unicode interrupt the byte strings, and with a
+# maximum distance.
+
+for my $max (undef, 3) {
+    for (1..10) {
+	my $word = random_word (1 + int (rand (12)), 'abcd');
+	my @words = map {random_word (int (rand (15)), 'abcd')} 1..300;
+	for (1..5) {
+	    utf8::upgrade ($words[int (rand (@words))]);
+	}
+	my $tf = Text::Fuzzy->new ($word);
+	$tf->set_max_distance ($max);
+	my @nearest = $tf->nearest (\@words);
+	my $one = $tf->nearest (\@words);
+	my @distances = map {$tf->distance ($_)} @words;
+	my ($min) = sort {$a <=> $b} @distances;
+	if (defined $max && $min > $max) {
+	    is_deeply (\@nearest, [], "nothing within $max of $word");
+	    ok (! defined $one, "nothing within $max of $word");
+	    next;
+	}
+	my @expect = grep {$distances[$_] == $min} 0..$#words;
+	is_deeply (\@nearest, \@expect, "nearest to $word in long list");
+	ok ((grep {$_ == $one} @expect), "scalar nearest to $word in long list");
+    }
+}
+
+# An empty search term is not compared several words at a time.
+
+for my $max (undef, 1, 2) {
+    my $tf = Text::Fuzzy->new ('');
+    $tf->set_max_distance ($max);
+    my @nearest = $tf->nearest (['abc', 'ab', 'abcd']);
+    if (defined $max && $max < 2) {
+	is_deeply (\@nearest, [], "nothing within $max of empty term");
+	next;
+    }
+    is_deeply (\@nearest, [1], "nearest to empty term");
+    is ($tf->last_distance (), 2, "last distance to empty term");
+}
+
+done_testing ();
+exit;
+
+# Check the distance from $word to $other with various maximum
+# distances.
+
+sub check_all
+{
+    my ($word, $other, $no_alphabet) = @_;
+    my $expect = levenshtein ($word, $other);
+    my $tf = Text::Fuzzy->new ($word);
+    if ($no_alphabet) {
+	$tf->no_alphabet (1);
+    }
+    is ($tf->distance ($other), $expect, "distance");
+    for my $max (0, 1, 2, 5, 10, 30, 100) {
+	$tf->set_max_distance ($max);
+	my $got = $tf->distance ($other);
+	if ($expect <= $max) {
+	    is ($got, $expect, "distance with max $max");
+	}
+	else {
+	    is ($got, $max + 1, "over max $max");
+	}
+    }
+}
+
+# Make $n random edits to $word, using the characters in $letters.
+
+sub mutate
+{
+    my ($word, $n, $letters) = @_;
+    $letters ||= 'abcde';
+    my @letters = split '', $letters;
+    my @word = split '', $word;
+    for (1..$n) {
+	my $pos = int (rand (@word + 1));
+	my $edit = int (rand (3));
+	my $letter = $letters[int (rand (@letters))];
+	if ($edit == 0 || ! @word) {
+	    splice @word, $pos, 0, $letter;
+	}
+	elsif ($edit == 1) {
+	    splice @word, $pos - 1, 1;
+	}
+	else {
+	    $word[$pos - 1] = $letter;
+	}
+    }
+    return join '', @word;
+}
+
+sub random_word
+{
+    my ($length, $letters) = @_;
+    my @letters = split '', $letters;
+    return join '', map {$letters[int (rand (@letters))]} 1..$length;
+}
+
+# Reference implementation of the Levenshtein edit distance.
+
+sub levenshtein
+{
+    my ($left, $right) = @_;
+    my @left = split '', $left;
+    my @right = split '', $right;
+    my @prev = (0..@right);
+    for my $i (1..@left) {
+	my @next = ($i);
+	for my $j (1..@right) {
+	    my $cost = $left[$i - 1] eq $right[$j - 1] ? 0 : 1;
+	    my $min = $prev[$j - 1] + $cost;
+	    $min = $prev[$j] + 1 if $prev[$j] + 1 < $min;
+	    $min = $next[$j - 1] + 1 if $next[$j - 1] + 1 < $min;
+	    push @next, $min;
+	}
+	@prev = @next;
+    }
+    return $prev[-1];
+}
@@ -35,4 +35,79 @@ my @words = qw/Have you ever kissed in the moonlight
 my $index = $tfc->nearest (\@words);
 is ($index, undef);
 
+# Strings too long for the match masks. The memory for these used to
+# be on the stack, which overflowed.
+
+my $long = 'ab' x 1_500_000;
+my $tfl = Text::Fuzzy->new ($long, max => 2);
+is ($tfl->distance ($long . 'c'), 1, "Distance to a very long string");
+is ($tfl->distance ('b' . $long), 1, "Distance to a very long string");
+my $tflt = Text::Fuzzy->new ($long, max => 2, trans => 1);
+is ($tflt->distance ('ba' . substr ($long, 2)), 1,
+    "Distance with transpositions to a very long string");
+
+# Long strings with a small maximum distance, where the edits are
+# away from the ends.
+
+for my $unicode (0, 1) {
+    my $base = join '', map {chr (ord ('a') + ($_ * 7) % 26)} 0..199;
+    if ($unicode) {
+	$base =~ tr/a-z/\x{3041}-\x{305a}/;
+    }
+    my $tfd = Text::Fuzzy->new ($base, max => 3);
+    my $edited = $base;
+    for my $n (1..4) {
+	# Replace one character, delete one, and insert one.
+	if ($n == 1) {
+	    substr ($edited, 50, 1, 'X');
+	}
+	elsif ($n == 2) {
+	    substr ($edited, 100, 1, '');
+	}
+	elsif ($n == 3) {
+	    substr ($edited, 150, 0, 'Y');
+	}
+	else {
+	    substr ($edited, 20, 2, 'Z');
+	}
+	my $got = $tfd->distance ($edited);
+	if ($n <= 3) {
+	    is ($got, $n, "$n edits to a long string, unicode $unicode");
+	}
+	else {
+	    cmp_ok ($got, '>', 3, "Over the maximum, unicode $unicode");
+	}
+    }
+}
+
+# With no maximum distance, long strings which are nearly the same
+# follow the diagonals too, or try increasing maximum distances, and
+# strings which are not give up on them and use another algorithm.
+
+for my $trans (0, 1, 'osa') {
+    for my $unicode (0, 1) {
+	my $base = join '', map {chr (ord ('a') + ($_ * 7) % 26)} 0..999;
+	if ($unicode) {
+	    $base =~ tr/a-z/\x{3041}-\x{305a}/;
+	}
+	my $tfw = Text::Fuzzy->new ($base, trans => $trans);
+	my $edited = $base;
+	substr ($edited, 300, 1, 'X');
+	substr ($edited, 500, 1, '');
+	substr ($edited, 700, 0, 'Y');
+	is ($tfw->distance ($edited), 3,
+	    "Nearly the same, trans $trans, unicode $unicode");
+	my $scattered = $base;
+	for my $i (1..60) {
+	    substr ($scattered, $i * 16, 1, 'Z');
+	}
+	my $tfr = Text::Fuzzy->new ($base, max => 1000, trans => $trans);
+	is ($tfw->distance ($scattered), $tfr->distance ($scattered),
+	    "Sixty edits, trans $trans, unicode $unicode");
+	my $reversed = reverse $base;
+	is ($tfw->distance ($reversed), $tfr->distance ($reversed),
+	    "Not nearly the same, trans $trans, unicode $unicode");
+    }
+}
+
 done_testing ();
@@ -50,6 +50,108 @@ cmp_ok ($tf2->ualphabet_rejections, '==', scalar @stuff, "alphabet rejections");
 
 is ($tf2->unicode_length (), 4);
 
+# These strings have the same characters as the search term, but in a
+# different order, so the q-gram filter rejects them.
+
+my $sentence = 'the quick brown fox jumps over the lazy dog ' x 3;
+my @shuffled = map {join ' ', reverse split / /, $sentence} 1..3;
+for my $unicode (0, 1) {
+    my $term = $sentence;
+    my @list = (@shuffled, $sentence . 'x');
+    if ($unicode) {
+	tr/a-z/\x{3041}-\x{305a}/ for $term, @list;
+    }
+    my $tfq = Text::Fuzzy->new ($term, max => 2);
+    is_deeply ([$tfq->nearest (\@list)], [3], "nearest, unicode $unicode");
+    cmp_ok ($tfq->qgram_rejections, '==', scalar @shuffled,
+	    "q-gram rejections, unicode $unicode");
+    $tfq->no_alphabet (1);
+    $tfq->nearest (\@list);
+    cmp_ok ($tfq->qgram_rejections, '==', 0, "no q-gram filter");
+}
+
+# All the characters of these strings are in the search term, but
+# there are too many of some of them, so the alphabet filters count
+# the characters to reject them.
+
+my $tfcount = Text::Fuzzy->new ('aaaabbbb', max => 2);
+my @counted = ('aaaaaaaa', 'aaabbbbb');
+is_deeply ([$tfcount->nearest (\@counted)], [1]);
+cmp_ok ($tfcount->alphabet_rejections, '==', 1, "alphabet counts");
+
+# Strings of sixteen or more bytes look for bytes which are not in the
+# search term many at a time. Check bytes above 0x7F too.
+
+no utf8;
+my $high = join '', map {chr (0x60 + $_ * 5)} 0..19;
+my $tfmask = Text::Fuzzy->new ($high, max => 3);
+my @masked = (
+    $high,
+    (substr ($high, 0, 16) . "\x01\x02\x03\x04"),
+    (substr ($high, 0, 17) . "\xFF\xFE\xFD"),
+    (substr ($high, 0, 16) . "\xFF\x01\xFE\x02"),
+);
+is_deeply ([$tfmask->nearest (\@masked)], [0]);
+cmp_ok ($tfmask->alphabet_rejections, '==', 2, "alphabet mask");
+is ($tfmask->distance ($masked[2]), 3, "three bytes not in the alphabet");
+use utf8;
+
+my $tfucount = Text::Fuzzy->new ('ああああいいいい', max => 2);
+my @ucounted = ('ああああああああ', 'あああいいいいい');
+is_deeply ([$tfucount->nearest (\@ucounted)], [1]);
+cmp_ok ($tfucount->ualphabet_rejections, '==', 1, "Unicode alphabet counts");
+
+# A search term whose characters are far apart, from ASCII to emoji.
+
+my $mixed = "fooの猫\x{1F431}barテスト";
+my $tfmixed = Text::Fuzzy->new ($mixed, max => 2);
+my @mixed = (
+    "fooの犬\x{1F436}barテスト",
+    "fooの猫\x{1F431}bazテスト",
+    "𝒻𝑜𝑜の猫\x{1F431}barテスト",
+    "\x{1F431}の猫fooテストbar",
+);
+is_deeply ([$tfmixed->nearest (\@mixed)], [1]);
+cmp_ok ($tfmixed->ualphabet_rejections, '==', 1, "Mixed scripts");
+is ($tfmixed->distance ($mixed[0]), 2, "Two characters not in the alphabet");
+
+# The alphabet filter cannot reject anagrams of the search term, so
+# after a few hundred of them it is skipped, and lets through the
+# strings after them which it would have rejected. Anagrams which only
+# move one letter are within the maximum distance, so they are left
+# out.
+
+srand (1905);
+my $letters = 'abcdefghij';
+my $tfletters = Text::Fuzzy->new ($letters);
+my @anagrams;
+while (@anagrams < 300) {
+    my @order = split //, $letters;
+    for my $i (reverse 1..$#order) {
+	my $j = int (rand ($i + 1));
+	@order[$i, $j] = @order[$j, $i];
+    }
+    my $anagram = join '', @order;
+    if ($tfletters->distance ($anagram) > 2) {
+	push @anagrams, $anagram;
+    }
+}
+for my $unicode (0, 1) {
+    my $term = $letters;
+    my @list = (@anagrams, 'klmnopqrst', 'abcdefghix');
+    if ($unicode) {
+	$term =~ tr/a-t/\x{3041}-\x{3054}/;
+	tr/a-t/\x{3041}-\x{3054}/ for @list;
+    }
+    my $tfskip = Text::Fuzzy->new ($term, max => 2);
+    is_deeply ([$tfskip->nearest (\@list)], [301], "nearest, unicode $unicode");
+    cmp_ok ($tfskip->alphabet_rejections + $tfskip->ualphabet_rejections,
+	    '==', 0, "skipped alphabet filter, unicode $unicode");
+    $tfskip->nearest ([@list[300, 301]]);
+    cmp_ok ($tfskip->alphabet_rejections + $tfskip->ualphabet_rejections,
+	    '==', 1, "alphabet filter back for the next list, unicode $unicode");
+}
+
 is ($tf2->get_trans (), 0);
 
 done_testing ();
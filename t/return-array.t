@@ -48,6 +48,14 @@ garden
 @nearest = $tf->nearest (\@funky_words);
 is_deeply (\@nearest, [0, 2, 4], "Picked out nearest words only");
 
+# Check that a search which finds nothing after one which found
+# something does not return the old matches.
+
+for my $word (qw/gibbon rice graham/) {
+    @nearest = $tf->nearest ([$word]);
+}
+is_deeply (\@nearest, [], "No matches after a search with matches");
+
 # Check that a complete mismatch returns an empty list.
 
 use utf8;
@@ -65,4 +73,26 @@ $tf2->set_max_distance (3);
 $tf2->nearest (\@funky_words);
 is ($tf2->get_max_distance (), 3, "Test value of max distance");
 
+# Check that "nearest" in scalar context after list context returns
+# the nearest word rather than trying to make a list.
+
+my $tf3 = Text::Fuzzy->new ('dice', max => 1);
+my @list = $tf3->nearest (\@funky_words);
+my $scalar = $tf3->nearest (\@funky_words);
+is ($scalar, 4, "Scalar context after list context");
+
+# Check that "distance" after "nearest" in list context does not add
+# to the list of matches, which "nearest" has already freed. The
+# memory of the list is counted, and it warns about a leak when the
+# object is destroyed.
+
+my @warnings;
+{
+    local $SIG{__WARN__} = sub {push @warnings, @_};
+    my $tf4 = Text::Fuzzy->new ('dice');
+    my @list4 = $tf4->nearest (\@words);
+    $tf4->distance ('nice');
+}
+is_deeply (\@warnings, [], "No leak from distance after nearest");
+
 done_testing ();
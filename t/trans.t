@@ -51,8 +51,174 @@ is( xs_edistance('ⓕⓞⓤⓡ','ⓕⓞⓤⓡⓣⓗ'), 2, 'test xs_edistance del
 is( xs_edistance('ⓕⓞⓤⓡ','ⓕⓤⓞⓡ'), 	1, 'test xs_edistance transposition (utf8)');
 is( xs_edistance('ⓕⓞⓤⓡ','ⓕⓧⓧⓡ'), 	2, 'test xs_edistance substitution (utf8)');
 
+# Compare with a reference implementation of the Damerau-Levenshtein
+# distance, with and without a maximum distance.
+
+srand (1066);
+for my $letters ('ab', 'abcd', 'あいうa') {
+    my @letters = split '', $letters;
+    for (1..40) {
+	my $left = join '', map {$letters[int (rand (@letters))]} 1..int (rand (30));
+	my $right = join '', map {$letters[int (rand (@letters))]} 1..int (rand (30));
+	my $expect = damerau ($left, $right);
+	my $tf = Text::Fuzzy->new ($left, trans => 1);
+	is ($tf->distance ($right), $expect, "distance '$left' '$right'");
+	for my $max (0, 1, 2, 3, 8) {
+	    $tf->set_max_distance ($max);
+	    my $got = $tf->distance ($right);
+	    is ($got, $expect <= $max ? $expect : $max + 1, "with max $max");
+	}
+    }
+}
+
+# Optimal string alignment distance. "ca" to "abc" is two with
+# Damerau-Levenshtein, but three with optimal string alignment, because
+# the transposed "ac" cannot have "b" inserted into it.
+
+my $osa = Text::Fuzzy->new ('ca', trans => 'osa');
+is ($osa->get_trans (), 'osa', "get_trans gives osa");
+is ($osa->distance ('abc'), 3, "osa distance");
+is ($osa->distance ('ac'), 1, "osa transposition");
+$osa->transpositions_ok (1);
+is ($osa->get_trans (), 1, "switch back to Damerau-Levenshtein");
+is ($osa->distance ('abc'), 2, "Damerau-Levenshtein distance");
+$osa->transpositions_ok ('osa');
+is ($osa->distance ('abc'), 3, "osa distance after transpositions_ok");
+$osa->set_max_distance (2);
+is ($osa->distance ('abc'), 3, "osa distance over a maximum of two");
+$osa->transpositions_ok (1);
+is ($osa->distance ('abc'), 2,
+    "Damerau-Levenshtein distance with a maximum of two");
+
+# Compare with a reference implementation, using search terms long
+# enough to need more than one machine word.
+
+for my $letters ('abc', 'あいうa') {
+    my @letters = split '', $letters;
+    for (1..40) {
+	my $left = join '', map {$letters[int (rand (@letters))]} 1..int (rand (150));
+	my @right = split '', $left;
+	for (1..int (rand (20))) {
+	    last if @right < 2;
+	    my $pos = int (rand (@right - 1));
+	    @right[$pos, $pos + 1] = @right[$pos + 1, $pos];
+	    $right[int (rand (@right))] = $letters[int (rand (@letters))];
+	}
+	my $right = join '', @right;
+	my $expect = osa ($left, $right);
+	my $tf = Text::Fuzzy->new ($left, trans => 'osa');
+	$tf->no_alphabet (1);
+	is ($tf->distance ($right), $expect, "osa distance");
+	for my $max (0, 1, 2, 3, 8) {
+	    $tf->set_max_distance ($max);
+	    my $got = $tf->distance ($right);
+	    is ($got, $expect <= $max ? $expect : $max + 1, "osa with max $max");
+	}
+    }
+}
+
+# A transposition into the first row of a block which has just come
+# into the band of the maximum distance.
+
+my $long = 'baaccacacabcbbccbaacbbcabbbcababacabacaaaaacaabbbabcaaaaacacabbabca';
+my $osal = Text::Fuzzy->new ($long, trans => 'osa', max => 42);
+is ($osal->distance ('cbabaacaacaabaaacaabbbacaac'), 42,
+    "osa transposition at the start of a block");
+
+# Strings with the same start and end, which are not given to the
+# edit distance calculation.
+
+for my $trans (0, 1, 'osa') {
+    my $tfa = Text::Fuzzy->new ('unbelievable', trans => $trans);
+    is ($tfa->distance ('unbeleivable'), $trans ? 1 : 2,
+	"Common prefix and suffix with trans $trans");
+    is ($tfa->distance ('unbelievable'), 0, "Identical strings");
+    is ($tfa->distance ('unbelievables'), 1, "Common prefix");
+    is ($tfa->distance ('nbelievable'), 1, "Common suffix");
+    my $tfu = Text::Fuzzy->new ('ばかばかしい', trans => $trans);
+    is ($tfu->distance ('ばかかばしい'), $trans ? 1 : 2,
+	"Unicode common prefix and suffix with trans $trans");
+    is ($tfu->distance ('ばかばかしいな'), 1, "Unicode common prefix");
+}
+
 done_testing ();
 
+# Optimal string alignment distance.
+
+sub osa
+{
+    my ($left, $right) = @_;
+    my @a = split '', $left;
+    my @b = split '', $right;
+    my @d;
+    for my $i (0..@a) {
+	$d[$i][0] = $i;
+    }
+    for my $j (0..@b) {
+	$d[0][$j] = $j;
+    }
+    for my $i (1..@a) {
+	for my $j (1..@b) {
+	    my $cost = $a[$i - 1] eq $b[$j - 1] ? 0 : 1;
+	    my @options = (
+		$d[$i - 1][$j - 1] + $cost,
+		$d[$i - 1][$j] + 1,
+		$d[$i][$j - 1] + 1,
+	    );
+	    if ($i > 1 && $j > 1 && $a[$i - 1] eq $b[$j - 2]
+		&& $a[$i - 2] eq $b[$j - 1]) {
+		push @options, $d[$i - 2][$j - 2] + 1;
+	    }
+	    my ($min) = sort {$a <=> $b} @options;
+	    $d[$i][$j] = $min;
+	}
+    }
+    return $d[@a][@b];
+}
+
+# Lowrance-Wagner algorithm for the Damerau-Levenshtein distance.
+
+sub damerau
+{
+    my ($left, $right) = @_;
+    my @a = split '', $left;
+    my @b = split '', $right;
+    my $inf = @a + @b;
+    my %last;
+    my @d;
+    $d[0][0] = $inf;
+    for my $i (0..@a) {
+	$d[$i + 1][0] = $inf;
+	$d[$i + 1][1] = $i;
+    }
+    for my $j (0..@b) {
+	$d[0][$j + 1] = $inf;
+	$d[1][$j + 1] = $j;
+    }
+    for my $i (1..@a) {
+	my $db = 0;
+	for my $j (1..@b) {
+	    my $i1 = $last{$b[$j - 1]} || 0;
+	    my $j1 = $db;
+	    my $cost = 1;
+	    if ($a[$i - 1] eq $b[$j - 1]) {
+		$cost = 0;
+		$db = $j;
+	    }
+	    my @options = (
+		$d[$i][$j] + $cost,
+		$d[$i + 1][$j] + 1,
+		$d[$i][$j + 1] + 1,
+		$d[$i1][$j1] + ($i - $i1 - 1) + 1 + ($j - $j1 - 1),
+	    );
+	    my ($min) = sort {$a <=> $b} @options;
+	    $d[$i + 1][$j + 1] = $min;
+	}
+	$last{$a[$i - 1]} = $i;
+    }
+    return $d[@a + 1][@b + 1];
+}
+
 sub xs_edistance
 {
     my ($left, $right) = @_;
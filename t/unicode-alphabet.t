@@ -16,4 +16,18 @@ my $is = $tf->nearest (\@words);
 cmp_ok ($is, '>=', 0, "Found in array");
 is ($words[$is], 'リヒテンシュタイン', "Found best match");
 is ($tf->last_distance, 7, "Found correct distance");
+
+# An empty search term marked as Unicode has no alphabet, and is at a
+# distance of the length of the other string.
+
+my $empty = 'ア';
+chop $empty;
+my $tfempty = Text::Fuzzy->new ($empty);
+is ($tfempty->distance ('アイウ'), 3, "Distance to an empty search term");
+is ($tfempty->distance (''), 0, "Empty string to an empty search term");
+is ($tfempty->nearest (['アイウエ', 'アイ', 'アイウ']), 1,
+    "Nearest to an empty search term");
+$tfempty->set_max_distance (5);
+is ($tfempty->distance ('アイウ'), 3, "Empty search term with maximum");
+
 done_testing ();
@@ -30,4 +30,37 @@ is ($jcat->distance ('ねこちゃん'), 3);
 no utf8;
 is ($cat->distance ('cart'), 1);
 
+# The string compared against is not changed.
+
+use utf8;
+my $gato = 'γάτος';
+$cat->distance ($gato);
+is ($gato, 'γάτος', "Unicode string not altered");
+
+# Characters from 0x80 to 0xFF are the same whether the string is
+# Unicode or not.
+
+my $cafe = "caf\x{e9}";
+my $ucafe = $cafe;
+utf8::upgrade ($ucafe);
+my $tfcafe = Text::Fuzzy->new ($cafe);
+is ($tfcafe->distance ($ucafe), 0, "Upgraded string against bytes");
+my $tfucafe = Text::Fuzzy->new ($ucafe);
+is ($tfucafe->distance ($cafe), 0, "Bytes against upgraded string");
+is ($tfucafe->distance ("caf\x{80}"), 1, "Not the same as 0x80");
+is ($tfucafe->unicode_length (), 4, "Unicode length of upgraded string");
+is ($jcat->distance ("\x{e9}"), 7, "Bytes against wide characters");
+
+# Long runs of ASCII mixed with characters of two, three and four
+# bytes of UTF-8.
+
+my $mixed = "abcdefghijklmnopqrstuvwxyz\x{e9}\x{3042}\x{1F600}abcdefghijklmnopq";
+my $tfmixed = Text::Fuzzy->new ($mixed);
+is ($tfmixed->unicode_length (), 46, "Length of mixed UTF-8");
+is ($tfmixed->distance ($mixed), 0, "Mixed UTF-8 against itself");
+my $changed = $mixed;
+$changed =~ s/\x{3042}/\x{3044}/;
+$changed =~ s/\x{1F600}/\x{1F601}/;
+is ($tfmixed->distance ($changed), 2, "Mixed UTF-8 with two changes");
+
 done_testing ();
@@ -83,32 +83,58 @@ static void allocate_b_unicode (text_fuzzy_t * text_fuzzy, int b_length)
     }
 }
 
-/* Given a Perl string in "text" which is marked as being Unicode
-   characters, use Perl's Unicode handlers to turn it into a string of
-   integers. */
+/* Decode the string "text" of "tfs", which is UTF-8, into
+   "tfs->unicode". The return value is the largest character in the
+   string, or -1 if it is empty. */
 
-static void sv_to_int_ptr (SV * text, text_fuzzy_string_t * tfs)
+static int text_to_int_ptr (text_fuzzy_string_t * tfs)
 {
     int i;
-    U8 * utf;
-    STRLEN curlen;
-    STRLEN length;
-    unsigned char * stuff;
+    int max_char;
 
-    stuff = (unsigned char *) SvPV (text, length);
-
-    utf = stuff;
-    curlen = length;
+    tfs->ulength = utf8_decode_chars ((const unsigned char *) tfs->text,
+				       tfs->length, tfs->unicode);
+    max_char = -1;
     for (i = 0; i < tfs->ulength; i++) {
-        STRLEN len;
+	if (tfs->unicode[i] > max_char) {
+	    max_char = tfs->unicode[i];
+	}
+    }
+    return max_char;
+}
+
+/* Given a Perl string in "text" which is marked as being Unicode
+   characters, turn it into the bytes "bytes", for a search term
+   which is not Unicode. Characters above 0xFF cannot be in the
+   search term, so they become "invalid_char", which is not in it
+   either. */
+
+static void sv_to_bytes (SV * text, unsigned char * bytes, int n_chars,
+			 unsigned char invalid_char)
+{
+    int i;
+    const unsigned char * utf;
+    const unsigned char * end;
+    STRLEN length;
 
-	/* The documentation for "utf8n_to_uvuni" can be found in
-	   "perldoc perlapi". There is an online version here:
-	   "http://perldoc.perl.org/perlapi.html#Unicode-Support". */
+    utf = (const unsigned char *) SvPV (text, length);
+    end = utf + length;
+    for (i = 0; i < n_chars; i++) {
+	int c;
 
-        tfs->unicode[i] = utf8n_to_uvuni (utf, curlen, & len, 0);
-        curlen -= len;
-        utf += len;
+	if (* utf < 0x80) {
+	    /* ASCII is the same in UTF-8. */
+	    bytes[i] = * utf;
+	    utf++;
+	    continue;
+	}
+	c = utf8_next_char (& utf, end);
+	if (c < 0x100) {
+	    bytes[i] = c;
+	}
+	else {
+	    bytes[i] = invalid_char;
+	}
     }
 }
 
@@ -137,20 +163,37 @@ sv_to_text_fuzzy (SV * text, text_fuzzy_t ** text_fuzzy_ptr)
     text_fuzzy->text.text[text_fuzzy->text.length] = '\0';
     is_utf8 = SvUTF8 (text);
     if (is_utf8) {
+	int max_char;
 
 	/* Put the Unicode version of the string into
 	   "text_fuzzy->text". */
 
-        text_fuzzy->unicode = 1;
-	text_fuzzy->text.ulength = sv_len_utf8 (text);
+	get_memory (text_fuzzy->text.unicode, text_fuzzy->text.length, int);
+
+	max_char = text_to_int_ptr (& text_fuzzy->text);
 
-	get_memory (text_fuzzy->text.unicode, text_fuzzy->text.ulength, int);
+	if (max_char < 0x100) {
 
-	sv_to_int_ptr (text, & text_fuzzy->text);
+	    /* Perl marks most strings as Unicode, even if all of
+	       their characters would fit into bytes. In that case,
+	       compare the string as bytes, since the byte algorithms
+	       are quicker. The Unicode version is kept for
+	       "unicode_length". */
+
+	    text_fuzzy->text.length = text_fuzzy->text.ulength;
+	    for (i = 0; i < text_fuzzy->text.length; i++) {
+		text_fuzzy->text.text[i] = text_fuzzy->text.unicode[i];
+	    }
+	    text_fuzzy->text.text[text_fuzzy->text.length] = '\0';
+	    TEXT_FUZZY (generate_alphabet (text_fuzzy));
+	}
+	else {
+	    text_fuzzy->unicode = 1;
 
-	/* Generate the Unicode alphabet. */
+	    /* Generate the Unicode alphabet. */
 
-	TEXT_FUZZY (generate_ualphabet (text_fuzzy));
+	    TEXT_FUZZY (generate_ualphabet (text_fuzzy));
+	}
     }
     else {
 	TEXT_FUZZY (generate_alphabet (text_fuzzy));
@@ -170,34 +213,30 @@ sv_to_text_fuzzy_string (SV * word, text_fuzzy_t * tf)
     STRLEN length;
     tf->b.text = SvPV (word, length);
     tf->b.length = length;
-    if (SvUTF8 (word) || tf->unicode) {
-
-	/* Make a Unicode version of b. */
-
-	tf->b.ulength = sv_len_utf8 (word);
-	allocate_b_unicode (tf, tf->b.ulength);
-	sv_to_int_ptr (word, & tf->b);
-	if (! tf->unicode) {
+    if (tf->unicode) {
 
-	    /* Make a non-Unicode version of b. */
+	/* Make room for a Unicode version of b, which
+	   "text_fuzzy_compare_single" makes from "tf->b.text" if it
+	   needs it. A string does not have more characters than
+	   bytes. */
 
-	    int i;
+	tf->b_utf8 = SvUTF8 (word) ? 1 : 0;
+	allocate_b_unicode (tf, length);
+    }
+    else if (SvUTF8 (word)) {
 
-	    tf->b.length = tf->b.ulength;
-	    for (i = 0; i < tf->b.ulength; i++) {
-		int c;
+	/* Make a non-Unicode version of b. This goes into the memory
+	   of "tf->b.unicode", which is not otherwise used for a
+	   non-Unicode search term, rather than into the string of
+	   "word". */
 
-		c = tf->b.unicode[i];
-		if (c <= 0x80) {
-		    tf->b.text[i] = c;
-		}
-		else {
-		    /* Put a non-matching character in there. */
-
-		    tf->b.text[i] = tf->invalid_char;
-		}
-	    }
-	}
+	tf->b.ulength = utf8_n_chars ((const unsigned char *) tf->b.text,
+				      tf->b.length);
+	allocate_b_unicode (tf, tf->b.ulength);
+	sv_to_bytes (word, (unsigned char *) tf->b.unicode, tf->b.ulength,
+		     tf->invalid_char);
+	tf->b.text = (char *) tf->b.unicode;
+	tf->b.length = tf->b.ulength;
     }
 }
 
@@ -221,9 +260,18 @@ text_fuzzy_av_distance (text_fuzzy_t * text_fuzzy, AV * words, AV * wantarray)
     int n_words;
     int nearest;
 
-    if (wantarray) {
-	text_fuzzy->wantarray = 1;
-    }
+    /* Do we compare runs of byte strings with "compare_batch"? An
+       empty search term has no match masks to shift, so it is not
+       batched. */
+
+    int batch;
+    text_fuzzy_string_t batch_words[BATCH_MAX_WORDS];
+
+    /* This must be reset each time, otherwise a call in scalar
+       context after one in list context tries to push the results
+       into a null array. */
+
+    text_fuzzy->wantarray = wantarray ? 1 : 0;
     TEXT_FUZZY (begin_scanning (text_fuzzy));
 
     nearest = -1;
@@ -236,9 +284,40 @@ text_fuzzy_av_distance (text_fuzzy_t * text_fuzzy, AV * words, AV * wantarray)
         return -1;
     }
 
-    for (i = 0; i < n_words; i++) {
+    batch = text_fuzzy->use_bits && text_fuzzy->text.length > 0 &&
+	! text_fuzzy->transpositions_ok && distance_simd_batch_lanes () > 0;
+
+    i = 0;
+    while (i < n_words) {
         SV * word;
         word = * av_fetch (words, i, 0);
+	if (batch && ! SvUTF8 (word)) {
+	    int n_batch;
+	    int stop;
+
+	    /* Collect a run of byte strings, and compare them with the
+	       search term all at once. */
+
+	    n_batch = 0;
+	    while (n_batch < BATCH_MAX_WORDS && i + n_batch < n_words) {
+		STRLEN length;
+
+		word = * av_fetch (words, i + n_batch, 0);
+		if (SvUTF8 (word)) {
+		    break;
+		}
+		batch_words[n_batch].text = SvPV (word, length);
+		batch_words[n_batch].length = length;
+		n_batch++;
+	    }
+	    TEXT_FUZZY (compare_batch (text_fuzzy, batch_words, n_batch, i,
+				       & nearest, & stop));
+	    if (stop) {
+		break;
+	    }
+	    i += n_batch;
+	    continue;
+	}
         sv_to_text_fuzzy_string (word, text_fuzzy);
 	text_fuzzy->offset = i;
         TEXT_FUZZY (compare_single (text_fuzzy));
@@ -252,6 +331,7 @@ text_fuzzy_av_distance (text_fuzzy_t * text_fuzzy, AV * words, AV * wantarray)
 		break;
 	    }
 	}
+	i++;
     }
     text_fuzzy->distance = text_fuzzy->max_distance;
 
@@ -285,6 +365,27 @@ text_fuzzy_av_distance (text_fuzzy_t * text_fuzzy, AV * words, AV * wantarray)
 }
 
 
+/* Convert "trans", the value of the "trans" parameter of "new" or the
+   argument of "transpositions_ok", into the value for
+   "text_fuzzy_set_transpositions". The string "osa" selects the
+   optimal string alignment distance, and any other true value
+   selects the Damerau-Levenshtein distance. */
+
+static int
+sv_to_transpositions (SV * trans)
+{
+    if (SvPOK (trans)) {
+	const char * p;
+	STRLEN len;
+
+	p = SvPV (trans, len);
+	if (len == strlen ("osa") && strncmp (p, "osa", len) == 0) {
+	    return TEXT_FUZZY_TRANS_OSA;
+	}
+    }
+    return SvTRUE (trans) ? 1 : 0;
+}
+
 /* Free the memory allocated to "text_fuzzy" and check that there has
    not been a memory leak. */
 
@@ -300,7 +401,7 @@ static int text_fuzzy_free (text_fuzzy_t * text_fuzzy)
 
     TEXT_FUZZY (free_memory (text_fuzzy));
 
-    if (text_fuzzy->unicode) {
+    if (text_fuzzy->text.unicode) {
         Safefree (text_fuzzy->text.unicode);
         text_fuzzy->n_mallocs--;
     }
@@ -7,6 +7,12 @@
 #include "edit-distance-int-trans.h"
 #include "edit-distance-char.h"
 #include "edit-distance-int.h"
+#include "edit-distance-bits.h"
+#include "edit-distance-simd.h"
+#include "edit-distance-diagonal.h"
+#include "edit-distance-within.h"
+#include "edit-distance-short.h"
+#include "utf8.h"
 
 #ifndef ERROR_HANDLER
 #define ERROR_HANDLER text_fuzzy_error_handler;
@@ -186,21 +192,44 @@ End:
 
 #ifdef HEADER
 
-/* Alphabet over unicode characters. */
+/* A machine word used as a bit vector by the bit-parallel edit
+   distance algorithms in "edit-distance-bits.c". */
 
-typedef struct ualphabet {
+#ifdef _MSC_VER
+typedef unsigned __int64 text_fuzzy_bits_t;
+#else /* _MSC_VER */
+typedef unsigned long long text_fuzzy_bits_t;
+#endif /* _MSC_VER */
 
-    /* The smallest character in our alphabet. */
-    int min;
+/* The number of bits in "text_fuzzy_bits_t". */
 
-    /* The largest character in our alphabet. */
-    int max;
+#define TEXT_FUZZY_BITS 64
 
-    /* Number of chars allocated in the following array. */
-    int size;
+/* The number of bits in the signature of a Unicode alphabet, and the
+   bit for character "c". This multiplies by a different number from
+   "TEXT_FUZZY_CHAR_HASH", so that characters which are near each
+   other in the hash table do not also share a bit. */
+
+#define TEXT_FUZZY_SIGNATURE_BITS 256
+#define TEXT_FUZZY_SIGNATURE_BIT(c) \
+    ((((unsigned int) (c)) * 0x85EBCA6BU) >> 24)
+
+/* Alphabet over unicode characters. */
+
+typedef struct ualphabet {
 
-    /* Array containing Unicode alphabet, as a bitmap. */
-    unsigned char * alphabet;
+    /* The number of times each character occurs in the search term,
+       indexed by the character's row in the hash table of the match
+       masks. Row zero, for characters which are not in the search
+       term, is always zero. */
+    int * counts;
+
+    /* A signature of the characters of the search term, with the bit
+       "TEXT_FUZZY_SIGNATURE_BIT" of each one set. Most characters
+       which are not in the search term have a clear bit, which shows
+       that they are not in it without looking them up in the hash
+       table. */
+    text_fuzzy_bits_t signature[TEXT_FUZZY_SIGNATURE_BITS / TEXT_FUZZY_BITS];
 
     /* The number of characters which were rejected using the Unicode
        alphabet. */
@@ -208,6 +237,141 @@ typedef struct ualphabet {
 }
 ualphabet_t;
 
+/* How much one of the filters which look at the characters of each
+   string has rejected lately. A filter which rejects few strings is
+   skipped for a while, so that it does not cost time on lists which
+   it does not help with, and then tried again, in case the list has
+   changed. */
+
+typedef struct text_fuzzy_filter {
+
+    /* The number of strings which the filter looked at, and which it
+       rejected, since it was last judged. */
+    int tries;
+    int rejections;
+
+    /* The number of strings still to let past without looking at
+       them. */
+    int skip;
+}
+text_fuzzy_filter_t;
+
+/* A slot of the hash table of the characters of a Unicode search
+   term. */
+
+typedef struct text_fuzzy_char {
+
+    /* The character, or -1 for an empty slot. */
+    int c;
+
+    /* The number of the match mask of "c". */
+    int row;
+}
+text_fuzzy_char_t;
+
+/* The first slot to look for Unicode character "c" in a hash table
+   of "1 << (32 - shift)" slots. This multiplies by a number near
+   2^32 divided by the golden ratio and takes the top bits, so that
+   runs of consecutive characters, such as kana, spread out. */
+
+#define TEXT_FUZZY_CHAR_HASH(c, shift) \
+    ((((unsigned int) (c)) * 0x9E3779B1U) >> (shift))
+
+/* The bit for the trigram of characters "c", "d" and "e" in a
+   bitmap of "1 << (32 - shift)" bits. Trigrams which share a bit
+   only make the q-gram filter reject fewer strings. */
+
+#define TEXT_FUZZY_QGRAM_HASH(c, d, e, shift)				\
+    TEXT_FUZZY_CHAR_HASH ((((unsigned int) (c)) * 0x9E3779B1U +	\
+			   (unsigned int) (d)) * 0x9E3779B1U +		\
+			  (unsigned int) (e), shift)
+
+/* Byte "c" of the alphabet mask "mask" is bit "(c >> 4) & 7" of
+   "mask[(c >> 7) * 16 + (c & 15)]". */
+
+#define TEXT_FUZZY_ALPHABET_BIT(mask, c)				\
+    (((mask)[((c) >> 7) * 16 + ((c) & 15)] >> (((c) >> 4) & 7)) & 1)
+
+/* Match masks of the search term for the blocked bit-parallel edit
+   distance, which is used for search terms which do not fit into one
+   machine word, and for Unicode search terms. */
+
+typedef struct text_fuzzy_masks {
+
+    /* The number of machine words in each match mask. */
+    int n_blocks;
+
+    /* The number of different characters in the search term. */
+    int n_chars;
+
+    /* The match masks, "n_blocks" words per character. The first
+       mask is all zeros, for characters not in the search term. */
+    text_fuzzy_bits_t * masks;
+
+    /* For byte strings, the number of the mask of each byte in
+       "masks". */
+    unsigned short row[0x100];
+
+    /* For Unicode strings, the different characters of the search
+       term in a hash table with open addressing. It has "n_slots"
+       slots, a power of two, at least twice the number of
+       characters, so there are always empty slots. Look up a
+       character "c" from slot "TEXT_FUZZY_CHAR_HASH (c, shift)",
+       moving to the next slot until finding "c" or an empty slot,
+       which has the character -1 and mask number zero. */
+    text_fuzzy_char_t * chars;
+    int n_slots;
+    int shift;
+}
+text_fuzzy_masks_t;
+
+/* "inline" for the lookups below, which are called for every
+   character. */
+
+#ifdef _MSC_VER
+#define TEXT_FUZZY_INLINE __inline
+#else /* _MSC_VER */
+#define TEXT_FUZZY_INLINE inline
+#endif /* _MSC_VER */
+
+/* The slot of Unicode character "c" in the hash table of "m", or the
+   empty slot where it would go if it is not in the search term. */
+
+static TEXT_FUZZY_INLINE unsigned int
+text_fuzzy_char_slot (const text_fuzzy_masks_t * m, int c)
+{
+    unsigned int slot;
+
+    slot = TEXT_FUZZY_CHAR_HASH (c, m->shift);
+    while (m->chars[slot].c != c && m->chars[slot].c >= 0) {
+	slot = (slot + 1) & (m->n_slots - 1);
+    }
+    return slot;
+}
+
+/* The row of Unicode character "c" in the hash table of "m", which
+   is zero if "c" is not in the search term. */
+
+static TEXT_FUZZY_INLINE int
+text_fuzzy_char_row (const text_fuzzy_masks_t * m, int c)
+{
+    return m->chars[text_fuzzy_char_slot (m, c)].row;
+}
+
+/* Scratch memory for the edit distance calculations. This is kept
+   from one comparison to the next, so that comparing a list of
+   strings does not allocate memory for each one. */
+
+typedef struct text_fuzzy_workspace {
+
+    /* The memory, or zero if none has been allocated yet. */
+    void * mem;
+
+    /* The number of bytes allocated to "mem". */
+    int size;
+}
+text_fuzzy_workspace_t;
+
 /* This structure contains one string of whatever type. */
 
 typedef struct text_fuzzy_string {
@@ -260,9 +424,42 @@ typedef struct text_fuzzy {
     /* The number of mallocs we are guilty of. */
     int n_mallocs;
 
-    /* ASCII alphabet */
+    /* ASCII alphabet, the number of times each byte occurs in the
+       search term. */
     int alphabet[0x100];
 
+    /* The bytes of the search term as a 256-bit mask. Byte "c" is
+       "TEXT_FUZZY_ALPHABET_BIT (alphabet_mask, c)", which is laid out
+       so that a SIMD shuffle can look up sixteen bytes at once. */
+    unsigned char alphabet_mask[0x20];
+
+    /* Match masks of the search term for the bit-parallel edit
+       distance. Bit "i" of "peq[c]" is set if byte "i" of "text" is
+       "c". These are only valid if "use_bits" is set. */
+    text_fuzzy_bits_t peq[0x100];
+
+    /* Match masks for the blocked bit-parallel edit distance. These
+       are only valid if "masks.masks" is not zero. */
+    text_fuzzy_masks_t masks;
+
+    /* Scratch memory for the edit distance calculations. */
+    text_fuzzy_workspace_t workspace;
+
+    /* Scratch memory for match masks made for one comparison, which
+       are used at the same time as "workspace". */
+    text_fuzzy_workspace_t masks_workspace;
+
+    /* The number of characters at the start of "text" and "b" which
+       were the same, and have been removed for the edit distance
+       calculation. The match masks are still those of the whole of
+       "text". */
+    int prefix;
+
+    /* The number of characters of "b" which the blocked bit-parallel
+       edit distance got through before every cell was over the
+       maximum distance, or zero if it did not give up part way. */
+    int stopped;
+
     /* The number of characters which were rejected using the ASCII
        alphabet. */
     int alphabet_rejections;
@@ -270,6 +467,22 @@ typedef struct text_fuzzy {
     /* Unicode alphabet. */
     ualphabet_t ualphabet;
 
+    /* The trigrams of the search term for the q-gram filter, as a
+       bitmap of "1 << (32 - qgram_shift)" bits, with the bit
+       "TEXT_FUZZY_QGRAM_HASH" of each trigram set. */
+    unsigned char * qgrams;
+    int qgram_shift;
+
+    /* The number of strings which were rejected using the q-gram
+       filter. */
+    int qgram_rejections;
+
+    /* How the alphabet filters and the q-gram filter are doing in
+       this scan. The byte and Unicode alphabet filters share
+       "alphabet_filter", since only one of them is used. */
+    text_fuzzy_filter_t alphabet_filter;
+    text_fuzzy_filter_t qgram_filter;
+
     /* The minimum distance we got in our most recent effort. */
     int distance;
 
@@ -311,6 +524,11 @@ typedef struct text_fuzzy {
        user does not want to use it.) */
     unsigned int use_alphabet : 1;
     unsigned int use_ualphabet : 1;
+    unsigned int use_qgrams : 1;
+
+    /* Does "peq" contain the match masks of "text"? This is true if
+       "text" is not Unicode and fits into a single machine word. */
+    unsigned int use_bits : 1;
 
     /* Variable edit costs? (currently unused) */
     unsigned int variable_edit_costs : 1;
@@ -318,12 +536,23 @@ typedef struct text_fuzzy {
     /* Do we account for transpositions? */
     unsigned int transpositions_ok : 1;
 
+    /* If transpositions are allowed, do we use the optimal string
+       alignment distance rather than the Damerau-Levenshtein
+       distance? */
+    unsigned int osa : 1;
+
     /* Did we find it? */
     unsigned int found : 1;
 
     /* Is this Unicode? */
     unsigned int unicode : 1;
 
+    /* Is "b.text" UTF-8, rather than bytes which are the characters?
+       This is only used if "unicode" is set. "b.unicode" is made from
+       "b.text" by "text_fuzzy_compare_single" if "b" gets past the
+       filters. */
+    unsigned int b_utf8 : 1;
+
     /* Do we want to skip exact matches? */
     unsigned int no_exact : 1;
 
@@ -335,6 +564,12 @@ typedef struct text_fuzzy {
 }
 text_fuzzy_t;
 
+/* The value of "transpositions" for
+   "text_fuzzy_set_transpositions" which selects the optimal string
+   alignment distance. */
+
+#define TEXT_FUZZY_TRANS_OSA 2
+
 /* The string is not unicode so its length in unicode characters is
    unknown. */
 
@@ -342,13 +577,161 @@ text_fuzzy_t;
 
 #endif /* HEADER */
 
-/* The following calculations need to be done twice, first when
-   creating the alphabet and second when looking up a new character in
-   it. The macro saves us from exasperating bugs. */
+/* Generate the match masks of "tf->text" for the blocked bit-parallel
+   edit distance in "tf->masks". If there would be more than
+   MASKS_MAX_WORDS words of masks, give up, and the dynamic
+   programming algorithm is used instead. */
+
+STATIC FUNC (generate_masks) (text_fuzzy_t * tf)
+{
+    text_fuzzy_masks_t * m;
+    int length;
+    int i;
+
+    m = & tf->masks;
+    if (tf->unicode) {
+	length = tf->text.ulength;
+    }
+    else {
+	length = tf->text.length;
+    }
+    if (length == 0) {
+	OK;
+    }
+    m->n_blocks = (length + TEXT_FUZZY_BITS - 1) / TEXT_FUZZY_BITS;
+
+    /* Number the different characters of the search term. */
+
+    if (tf->unicode) {
+	text_fuzzy_char_t * chars;
+	int bits;
+
+	/* Make room for twice as many characters as the search term
+	   could have. */
+
+	bits = 2;
+	while ((1 << bits) < 2 * length) {
+	    bits++;
+	}
+	m->n_slots = 1 << bits;
+	m->shift = 32 - bits;
+	chars = malloc (m->n_slots * sizeof (text_fuzzy_char_t));
+	FAIL (! chars, memory_error);
+	tf->n_mallocs++;
+	for (i = 0; i < m->n_slots; i++) {
+	    chars[i].c = -1;
+	    chars[i].row = 0;
+	}
+	m->chars = chars;
+	m->n_chars = 0;
+	for (i = 0; i < length; i++) {
+	    int c;
+	    unsigned int slot;
+
+	    c = tf->text.unicode[i];
+	    slot = text_fuzzy_char_slot (m, c);
+	    if (chars[slot].c < 0) {
+		m->n_chars++;
+		chars[slot].c = c;
+		chars[slot].row = m->n_chars;
+	    }
+	}
+    }
+    else {
+	for (i = 0; i < 0x100; i++) {
+	    m->row[i] = 0;
+	}
+	m->n_chars = 0;
+	for (i = 0; i < length; i++) {
+	    int c;
+
+	    c = (unsigned char) tf->text.text[i];
+	    if (! m->row[c]) {
+		m->n_chars++;
+		m->row[c] = m->n_chars;
+	    }
+	}
+    }
+
+    if (m->n_blocks > MASKS_MAX_WORDS / (m->n_chars + 1)) {
+	MESSAGE ("Too many match masks %d x %d.\n",
+		 m->n_chars + 1, m->n_blocks);
+	OK;
+    }
+    m->masks = calloc ((m->n_chars + 1) * m->n_blocks,
+		       sizeof (text_fuzzy_bits_t));
+    FAIL (! m->masks, memory_error);
+    tf->n_mallocs++;
+
+    for (i = 0; i < length; i++) {
+	int row;
+
+	if (tf->unicode) {
+	    row = text_fuzzy_char_row (m, tf->text.unicode[i]);
+	    FAIL (row == 0, max_min_miscalculation);
+	}
+	else {
+	    row = m->row[(unsigned char) tf->text.text[i]];
+	}
+	m->masks[row * m->n_blocks + i / TEXT_FUZZY_BITS] |=
+	    ((text_fuzzy_bits_t) 1) << (i % TEXT_FUZZY_BITS);
+    }
+    OK;
+}
+
+/* Make the bitmap of the trigrams of "tf->text" for the q-gram
+   filter in "tf->qgrams". Search terms shorter than QGRAM_MIN_LENGTH
+   do not use the filter, since their edit distances are quick. */
 
-#define BYTE_BIT				\
-    byte = ((c - u->min) / 8) ;			\
-    bit = 1 << (c % 8);
+STATIC FUNC (generate_qgrams) (text_fuzzy_t * tf)
+{
+    int length;
+    int bits;
+    int i;
+
+    if (tf->unicode) {
+	length = tf->text.ulength;
+    }
+    else {
+	length = tf->text.length;
+    }
+    if (length < QGRAM_MIN_LENGTH) {
+	OK;
+    }
+
+    /* Make sixteen times as many bits as there are trigrams, so that
+       few other trigrams share a bit with them. */
+
+    bits = 3;
+    while ((1 << bits) < 16 * length) {
+	bits++;
+    }
+    tf->qgram_shift = 32 - bits;
+    tf->qgrams = calloc ((1 << bits) / 8, sizeof (unsigned char));
+    FAIL (! tf->qgrams, memory_error);
+    tf->n_mallocs++;
+
+    for (i = 2; i < length; i++) {
+	unsigned int bit;
+
+	if (tf->unicode) {
+	    bit = TEXT_FUZZY_QGRAM_HASH (tf->text.unicode[i - 2],
+					 tf->text.unicode[i - 1],
+					 tf->text.unicode[i],
+					 tf->qgram_shift);
+	}
+	else {
+	    const unsigned char * t;
+
+	    t = (const unsigned char *) tf->text.text;
+	    bit = TEXT_FUZZY_QGRAM_HASH (t[i - 2], t[i - 1], t[i],
+					 tf->qgram_shift);
+	}
+	tf->qgrams[bit / 8] |= 1 << (bit % 8);
+    }
+    tf->use_qgrams = 1;
+    OK;
+}
 
 /* Generate the Unicode alphabet in "tf->ualphabet". */
 
@@ -373,164 +756,829 @@ FUNC (generate_ualphabet) (text_fuzzy_t * tf)
     u = & tf->ualphabet;
     t = & tf->text;
 
+    CALL (generate_masks (tf));
+
+    if (t->ulength == 0) {
+
+	/* There is no alphabet to make, and no hash table of the
+	   characters to count them by. */
+
+	OK;
+    }
+
     MESSAGE ("Alphabetizing %s\n", t->text);
 
-    /* Set the maximum to the smallest possible value and the minimum
-       to the largest possible value. */
+    /* Count the characters by their rows in "tf->masks", with room
+       for row zero. */
 
-    u->min = INT_MAX;
-    u->max = INT_MIN;
+    u->counts = calloc (tf->masks.n_chars + 1, sizeof (int));
+    FAIL (! u->counts, memory_error);
 
-    /* Get the minimum and maximum values. */
+    tf->n_mallocs++;
 
     for (i = 0; i < t->ulength; i++) {
+	unsigned int bit;
 
-	/* Character at position "i". */
+	u->counts[text_fuzzy_char_row (& tf->masks, t->unicode[i])]++;
+	bit = TEXT_FUZZY_SIGNATURE_BIT (t->unicode[i]);
+	u->signature[bit / TEXT_FUZZY_BITS] |=
+	    ((text_fuzzy_bits_t) 1) << (bit % TEXT_FUZZY_BITS);
+    }
 
-	int c;
+    /* With many different characters, most of the bits are set, and
+       the signature only costs time, so set all of them, and every
+       character is looked up. */
 
-	c = t->unicode[i];
+    if (tf->masks.n_chars > TEXT_FUZZY_SIGNATURE_BITS / 2) {
+	for (i = 0; i < TEXT_FUZZY_SIGNATURE_BITS / TEXT_FUZZY_BITS; i++) {
+	    u->signature[i] = ~ (text_fuzzy_bits_t) 0;
+	}
+    }
 
-	if (c > u->max) {
-	    u->max = c;
+    CALL (generate_qgrams (tf));
+
+    /* We have succeeded. */
+
+    tf->use_ualphabet = 1;
+
+    MESSAGE ("%d different characters\n", tf->masks.n_chars);
+
+    OK;
+}
+
+/* Put the characters of "tf->b.text" into "tf->b.unicode", which has
+   room for at least "tf->b.length" of them. */
+
+static void b_decode (text_fuzzy_t * tf)
+{
+    const unsigned char * s;
+    int i;
+
+    s = (const unsigned char *) tf->b.text;
+    if (! tf->b_utf8) {
+	for (i = 0; i < tf->b.length; i++) {
+	    tf->b.unicode[i] = s[i];
 	}
-	if (c < u->min) {
-	    u->min = c;
+	return;
+    }
+    utf8_decode_chars (s, tf->b.length, tf->b.unicode);
+}
+
+/* This returns 1 if filter "f" should look at the next string, and
+   0 if it is being skipped. */
+
+static int filter_on (text_fuzzy_filter_t * f)
+{
+    if (f->skip > 0) {
+	f->skip--;
+	return 0;
+    }
+    return 1;
+}
+
+/* Count a string which filter "f" looked at, and whether it was
+   "rejected", which is also the return value. Every
+   FILTER_SAMPLE_SIZE strings, if the filter rejected fewer than one
+   in FILTER_MIN_REJECT_RATIO of them, it is skipped for the next
+   FILTER_SKIP_SIZE strings. The edit distance of a string which a
+   filter does not reject costs much more than the filter, so a filter
+   is only skipped if it rejects hardly anything. */
+
+static int filter_result (text_fuzzy_filter_t * f, int rejected)
+{
+    f->tries++;
+    f->rejections += rejected;
+    if (f->tries == FILTER_SAMPLE_SIZE) {
+	if (f->rejections * FILTER_MIN_REJECT_RATIO < f->tries) {
+	    MESSAGE ("Skipping a filter which rejected %d of %d.\n",
+		     f->rejections, f->tries);
+	    f->skip = FILTER_SKIP_SIZE;
 	}
+	f->tries = 0;
+	f->rejections = 0;
     }
+    return rejected;
+}
 
-    MESSAGE ("Range is %X - %X\n", u->min, u->max);
+/* This returns a true value if the difference between the character
+   counts of "b" and of "tf" shows that their distance is greater than
+   "limit". See "bytes_rejected" for the bound. */
 
-    /* The number of bytes we need to store the alphabet. */
+static int ualphabet_miss (text_fuzzy_t * tf, text_fuzzy_string_t * b,
+			   int limit)
+{
+    int i;
+    int n;
 
-    u->size = u->max /8 - u->min / 8 + 1;
+    /* The next character of "b->text", and its end. */
 
-    if (u->size >= UALPHABET_MAX_SIZE) {
+    const unsigned char * s;
+    const unsigned char * end;
 
-	/* Give up trying to make this alphabet. */
+    /* "counts" is the count of each character of "tf->text", which
+       this takes the characters of "b" away from, and then puts
+       back. */
 
-	OK;
+    int * counts;
+
+    /* This runs before "b->unicode" is made, so it reads the
+       characters from "b->text", and keeps their rows in the memory
+       of "b->unicode", to put the counts back. */
+
+    int * rows;
+
+    /* The signature of the characters of "tf->text". */
+
+    const text_fuzzy_bits_t * signature;
+
+    /* The number of characters of "b" which are not in "tf->text",
+       counting each repeat beyond the number in "tf->text". */
+
+    int excess;
+
+    if (! filter_on (& tf->alphabet_filter)) {
+	return 0;
     }
+    counts = tf->ualphabet.counts;
+    signature = tf->ualphabet.signature;
+    rows = b->unicode;
+    excess = 0;
+    s = (const unsigned char *) b->text;
+    end = s + b->length;
+    for (i = 0; i < b->ulength; i++) {
 
-    /* Create a zeroed alphabet. */
+	int c;
+	int row;
+	unsigned int bit;
 
-    u->alphabet = calloc (u->size, sizeof (char));
-    FAIL (! u->alphabet, memory_error);
+	if (tf->b_utf8 && * s >= 0x80) {
+	    c = utf8_next_char (& s, end);
+	}
+	else {
+	    c = * s++;
+	}
+	bit = TEXT_FUZZY_SIGNATURE_BIT (c);
+	if ((signature[bit / TEXT_FUZZY_BITS] >> (bit % TEXT_FUZZY_BITS)) & 1) {
+	    row = text_fuzzy_char_row (& tf->masks, c);
+	}
+	else {
+	    row = 0;
+	}
+	rows[i] = row;
+	counts[row]--;
+	if (counts[row] < 0) {
+	    excess++;
+
+	    /* If we have too many misses, stop searching. */
+
+	    if (excess > limit) {
+		MESSAGE ("%s:%s: %d misses over %d: ",
+			 tf->text.text, tf->b.text, excess, limit);
+		i++;
+		break;
+	    }
+	}
+    }
+    for (n = 0; n < i; n++) {
+	counts[rows[n]]++;
+    }
+    return filter_result (& tf->alphabet_filter, excess > limit);
+}
 
-    tf->n_mallocs++;
+/* This is a value for the edit distance which indicates complete
+   failure to match. */
 
-    /* Get the minimum and maximum values. */
+#define NOT_FOUND -1
 
-    for (i = 0; i < t->ulength; i++) {
+#define LENGTH_REJECT(x,y)						\
+    MESSAGE ("Length of %d can never match %d within %d edits",		\
+	     (x), (y), tf->max_distance);				\
+    tf->length_rejections++
 
-	/* Character at position "i". */
 
+/* The q-gram filter. This cuts "b" into trigrams which do not
+   overlap. An edit can break at most one of them, and a transposition
+   at most two, so if "b" is within the maximum distance, all but that
+   many per edit of them are also trigrams of the search term. Looking
+   only at these trigrams of "b", rather than at all of its trigrams,
+   makes the filter three times quicker. This counts the trigrams
+   whose bit is set in "tf->qgrams", which may count trigrams which
+   share a bit with one of the search term's, but never misses any
+   which are in the search term. The "length" characters of "b" are
+   in "bytes" or "chars". The return value is 1 if "b" was rejected,
+   and 0 otherwise. */
 
+static int
+qgrams_rejected (text_fuzzy_t * tf, const unsigned char * bytes,
+		 const int * chars, int length, int term_length)
+{
+    int need;
+    int shared;
+    int i;
 
-	int c;
+    /* With a large maximum distance, very few strings are rejected,
+       so it is not worth looking. */
 
-	/* Byte and bit offset of c in u->alphabet. */
+    if (tf->max_distance > term_length / QGRAM_LENGTH_RATIO) {
+	return 0;
+    }
+    need = length / 3;
+    if (tf->transpositions_ok) {
+	need -= 2 * tf->max_distance;
+    }
+    else {
+	need -= tf->max_distance;
+    }
+    if (need <= 0) {
+	return 0;
+    }
+    if (! filter_on (& tf->qgram_filter)) {
+	return 0;
+    }
+    shared = 0;
+    for (i = 0; i + 3 <= length; i += 3) {
+	unsigned int bit;
 
-	int byte;
-	unsigned char bit;
+	if (bytes) {
+	    bit = TEXT_FUZZY_QGRAM_HASH (bytes[i], bytes[i + 1], bytes[i + 2],
+					 tf->qgram_shift);
+	}
+	else {
+	    bit = TEXT_FUZZY_QGRAM_HASH (chars[i], chars[i + 1], chars[i + 2],
+					 tf->qgram_shift);
+	}
+	shared += (tf->qgrams[bit / 8] >> (bit % 8)) & 1;
+	if (shared >= need) {
+	    return filter_result (& tf->qgram_filter, 0);
+	}
 
-	c = t->unicode[i];
-	FAIL (c > u->max || c < u->min, max_min_miscalculation);
+	/* Give up when the trigrams after this one could not make
+	   enough. */
 
-	BYTE_BIT;
-	MESSAGE ("Accepting %X at byte %X, bit %X.\n", c, byte, bit);
-	FAIL_MSG (byte < 0 || byte >= u->size, max_min_miscalculation,
-		  "The value of byte is %d, not within 0 - %d", byte, u->size);
+	if (shared + (length - i - 3) / 3 < need) {
+	    break;
+	}
+    }
+    return filter_result (& tf->qgram_filter, 1);
+}
+
+/* The byte version of "ualphabet_miss", for "tf->b" and the counts
+   in "tf->alphabet". */
 
-	u->alphabet[byte] |= bit;
+static int alphabet_miss (text_fuzzy_t * tf, int limit)
+{
+    int excess;
+    int l;
+    int n;
+
+    if (! filter_on (& tf->alphabet_filter)) {
+	return 0;
     }
 
-    /* We have succeeded. */
+    /* The bytes of "b" which are not in the search term at all are
+       part of the excess, and are counted many at a time. */
 
-    tf->use_ualphabet = 1;
+    if (tf->b.length >= ALPHABET_SIMD_MIN_LENGTH &&
+	distance_simd_misses (tf->alphabet_mask,
+			      (const unsigned char *) tf->b.text,
+			      tf->b.length) > limit) {
+	return filter_result (& tf->alphabet_filter, 1);
+    }
+    excess = 0;
+    for (l = 0; l < tf->b.length; l++) {
 
-    MESSAGE ("Size %d, min %d, max %d\n", u->size, u->min, u->max);
+	int a = (unsigned char) tf->b.text[l];
 
-    OK;
+	tf->alphabet[a]--;
+	if (tf->alphabet[a] < 0) {
+	    excess++;
+	    if (excess > limit) {
+		l++;
+		break;
+	    }
+	}
+    }
+    for (n = 0; n < l; n++) {
+	tf->alphabet[(unsigned char) tf->b.text[n]]++;
+    }
+    return filter_result (& tf->alphabet_filter, excess > limit);
 }
 
-/* This returns a true value if the difference between the alphabet of
-   "b" and the alphabet of "tf" is greater than the maximum distance
-   which "tf" will accept. */
+/* Run the filters which reject byte string "tf->b" without
+   computing the edit distance. The return value is 1 if "tf->b"
+   was rejected, and 0 otherwise. */
 
-static int ualphabet_miss (text_fuzzy_t * tf, text_fuzzy_string_t * b)
+static int
+bytes_rejected (text_fuzzy_t * tf)
+{
+    if (tf->max_distance != NO_MAX_DISTANCE) {
+
+	/* If the distance in the length of the strings is greater
+	   than the max distance, give up. */
+
+	if (abs (tf->text.length - tf->b.length) > tf->max_distance) {
+
+	    LENGTH_REJECT (tf->b.length, tf->text.length);
+
+	    return 1;
+	}
+
+	/* Alphabet filter: eliminate terms which cannot match.
+
+	   Each edit changes the number of one or two characters by
+	   one, and a transposition changes none, so the distance is
+	   at least the number of characters of "b" in excess of
+	   those in the search term, and at least the number of
+	   characters of the search term in excess of those in "b",
+	   which is the first number plus the difference in the
+	   lengths. The count of each character of "b" is taken away
+	   from "tf->alphabet" until the excess is too many, and then
+	   put back. */
+
+	if (tf->use_alphabet) {
+	    int limit;
+
+	    limit = tf->max_distance;
+	    if (tf->text.length > tf->b.length) {
+		limit -= tf->text.length - tf->b.length;
+	    }
+
+	    /* The excess cannot be more than the length of "b". */
+
+	    if (tf->b.length > limit && alphabet_miss (tf, limit)) {
+
+		/* It is not possible that the two words are within the
+		   maximum edit distance of each other. */
+
+		tf->alphabet_rejections++;
+		return 1;
+	    }
+	}
+	if (tf->use_qgrams &&
+	    qgrams_rejected (tf, (const unsigned char *) tf->b.text, 0,
+			     tf->b.length, tf->text.length)) {
+	    tf->qgram_rejections++;
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/* The number of bytes at the end of "a" and "b", which end at "a_end"
+   and "b_end", which are the same, up to "n". */
+
+static int
+common_suffix (const unsigned char * a_end, const unsigned char * b_end,
+	       int n)
 {
     int i;
 
-    /* "u" is a pointer to the alphabet in "tf". This saves repeatedly
-       typing "tf->ualphabet". */
+    i = 0;
+    while (i + (int) sizeof (text_fuzzy_bits_t) <= n) {
+	text_fuzzy_bits_t x;
+	text_fuzzy_bits_t y;
 
-    ualphabet_t * u;
+	memcpy (& x, a_end - i - sizeof (x), sizeof (x));
+	memcpy (& y, b_end - i - sizeof (y), sizeof (y));
+	if (x != y) {
+	    break;
+	}
+	i += sizeof (text_fuzzy_bits_t);
+    }
+    while (i < n && a_end[- i - 1] == b_end[- i - 1]) {
+	i++;
+    }
+    return i;
+}
 
-    /* The number of misses. */
+/* Remove the characters at the start and end of "tf->text" and
+   "tf->b" which are the same, since they do not change the edit
+   distance, with or without transpositions, so that the edit distance
+   calculations only need to look at the parts which differ. The
+   difference of the lengths, which the length filter looks at, stays
+   the same. The original strings are put into "text" and "b" for
+   "restore_affixes". */
+
+static void
+strip_affixes (text_fuzzy_t * tf, text_fuzzy_string_t * text,
+	       text_fuzzy_string_t * b)
+{
+    int prefix;
+    int suffix;
+    int n;
 
-    int misses;
+    * text = tf->text;
+    * b = tf->b;
+    if (tf->unicode) {
+	n = text->ulength;
+	if (b->ulength < n) {
+	    n = b->ulength;
+	}
+	prefix = 0;
+	while (prefix < n && text->unicode[prefix] == b->unicode[prefix]) {
+	    prefix++;
+	}
+	suffix = 0;
+	while (suffix < n - prefix &&
+	       text->unicode[text->ulength - 1 - suffix] ==
+	       b->unicode[b->ulength - 1 - suffix]) {
+	    suffix++;
+	}
+	tf->text.unicode += prefix;
+	tf->text.ulength -= prefix + suffix;
+	tf->b.unicode += prefix;
+	tf->b.ulength -= prefix + suffix;
+    }
+    else {
+	const unsigned char * t;
+	const unsigned char * u;
+
+	t = (const unsigned char *) text->text;
+	u = (const unsigned char *) b->text;
+	n = text->length;
+	if (b->length < n) {
+	    n = b->length;
+	}
+	prefix = diagonal_common_prefix (t, u, n);
+	suffix = common_suffix (t + text->length, u + b->length, n - prefix);
+	tf->text.text += prefix;
+	tf->text.length -= prefix + suffix;
+	tf->b.text += prefix;
+	tf->b.length -= prefix + suffix;
+    }
+    tf->prefix = prefix;
+}
 
-    FAIL (tf->max_distance == NO_MAX_DISTANCE, max_distance_misuse);
+/* Undo "strip_affixes". */
 
-    u = & tf->ualphabet;
+static void
+restore_affixes (text_fuzzy_t * tf, const text_fuzzy_string_t * text,
+		 const text_fuzzy_string_t * b)
+{
+    tf->text = * text;
+    tf->b = * b;
+    tf->prefix = 0;
+}
 
-    misses = 0;
+/* The functions for each maximum distance up to WITHIN_MAX_DISTANCE,
+   which handle every kind of edit distance, for byte strings and
+   Unicode strings. */
 
-    for (i = 0; i < tf->b.ulength; i++) {
+typedef int (* distance_t) (text_fuzzy_t * tf);
 
-	int c;
+static const distance_t within_char[WITHIN_MAX_DISTANCE + 1] = {
+    distance_within0_char,
+    distance_within1_char,
+    distance_within2_char,
+};
+
+static const distance_t within_int[WITHIN_MAX_DISTANCE + 1] = {
+    distance_within0_int,
+    distance_within1_int,
+    distance_within2_int,
+};
+
+/* Is the maximum distance small enough for "within_char" and
+   "within_int"? */
 
-	c = tf->b.unicode[i];
-	MESSAGE ("Looking for %X: ", c);
+static int
+use_within (text_fuzzy_t * tf)
+{
+    return tf->max_distance != NO_MAX_DISTANCE &&
+	tf->max_distance <= WITHIN_MAX_DISTANCE;
+}
+
+/* Should the Levenshtein edit distance between "tf->text" and "tf->b"
+   be computed by following the diagonals of the matrix? This is
+   quicker than the other algorithms when the maximum distance is
+   small compared to the length of the search term, since the work
+   depends mostly on the maximum distance rather than on the
+   lengths of the strings. "length" is the length of the search
+   term in the units being compared. */
 
-	/* Eliminate too large or too small. */
+static int
+use_diagonals (text_fuzzy_t * tf, int length)
+{
+    return tf->max_distance != NO_MAX_DISTANCE &&
+	tf->max_distance <= DIAGONAL_MAX_DISTANCE &&
+	tf->max_distance * DIAGONAL_LENGTH_RATIO <= length;
+}
 
-	if (c >= u->min && c <= u->max) {
+/* Should the Levenshtein edit distance between "tf->text" and "tf->b"
+   be tried by following the diagonals when there is no maximum
+   distance? If the strings are nearly the same, this finds the
+   distance in time which depends on the distance rather than on the
+   lengths, and otherwise it gives up early and another algorithm is
+   used. */
 
-	    /* Byte and bit offset of c in u->alphabet. */
+static int
+use_wavefront (text_fuzzy_t * tf, int length)
+{
+    return ! tf->transpositions_ok &&
+	tf->max_distance == NO_MAX_DISTANCE &&
+	length >= WAVEFRONT_MIN_LENGTH;
+}
 
-	    int byte;
-	    unsigned char bit;
+/* Should an edit distance with no maximum distance be found by trying
+   increasing maximum distances? "length" is the length of the search
+   term in the units being compared. */
 
-	    BYTE_BIT;
+static int
+use_search (text_fuzzy_t * tf, int length)
+{
+    return tf->max_distance == NO_MAX_DISTANCE &&
+	length >= WAVEFRONT_MIN_LENGTH;
+}
 
-	    MESSAGE (" byte %X, bit %X: ", byte, bit);
+/* Find the edit distance between "tf->text" and "tf->b" with
+   "distance", with no maximum distance, by trying increasing maximum
+   distances, starting from "k". The algorithms with a maximum
+   distance only compute a band of the matrix around the diagonal, so
+   the one which succeeds costs time proportional to the distance.
+   They stop as soon as the whole band is over the maximum. If the
+   blocked bit-parallel algorithm stops part of the way through
+   "tf->b", the distance is estimated from how far it got, so that
+   strings which are not alike do not waste time on one attempt after
+   another. Otherwise the maximum distance doubles. Once the band
+   would cover too much of the matrix, this gives up and returns
+   -1. */
 
-	    /* Exact check against the alphabet of "tf". */
+static int
+search_distance (text_fuzzy_t * tf, distance_t distance, int k, int length)
+{
+    int b_length;
+    int d;
 
-	    if (! (u->alphabet[byte] & bit)) {
-		MESSAGE ("not ");
-		misses++;
+    if (tf->unicode) {
+	b_length = tf->b.ulength;
+    }
+    else {
+	b_length = tf->b.length;
+    }
+    d = -1;
+    while (k * SEARCH_LENGTH_RATIO <= length) {
+	int next;
+
+	tf->max_distance = k;
+	tf->stopped = 0;
+	d = (* distance) (tf);
+	if (d <= k) {
+	    break;
+	}
+	d = -1;
+	next = 2 * k;
+	if (tf->stopped > 0) {
+	    double estimate;
+
+	    /* Allow a quarter more than the distance would be if it
+	       kept growing at the same rate. */
+
+	    estimate = 1.25 * (k + 1) * b_length / tf->stopped;
+	    if (estimate > length) {
+		break;
+	    }
+	    if ((int) estimate > next) {
+		next = (int) estimate;
 	    }
-	    MESSAGE ("there.\n");
+	}
+	k = next;
+    }
+    tf->max_distance = NO_MAX_DISTANCE;
+    return d;
+}
+
+/* Find the Damerau-Levenshtein distance between "tf->text" and
+   "tf->b" with "distance", with no maximum distance. Failed attempts
+   with a maximum distance cost too much with transpositions, but the
+   Levenshtein distance, which the bit-parallel algorithms find
+   quickly, is never less than the Damerau-Levenshtein distance, so
+   it is used as the maximum distance. If it is too large for that to
+   save time, this returns -1. */
+
+static int
+search_trans_distance (text_fuzzy_t * tf, distance_t distance, int length)
+{
+    int d;
+
+    tf->transpositions_ok = 0;
+    d = (* distance) (tf);
+    tf->transpositions_ok = 1;
+    if (d * SEARCH_LENGTH_RATIO > length) {
+	return -1;
+    }
+    tf->max_distance = d;
+    d = (* distance) (tf);
+    tf->max_distance = NO_MAX_DISTANCE;
+    return d;
+}
+
+/* The edit distance between the Unicode strings "tf->text" and
+   "tf->b", after "strip_affixes", using whichever algorithm suits
+   them and the maximum distance. */
+
+static int
+int_distance (text_fuzzy_t * tf)
+{
+    if (use_within (tf)) {
+	return (* within_int[tf->max_distance]) (tf);
+    }
+    if ((! tf->transpositions_ok || tf->osa) &&
+	tf->text.ulength <= SHORT_MAX_LENGTH) {
+	return distance_short_int (tf);
+    }
+    if (use_search (tf, tf->text.ulength)) {
+	int d;
+	int k;
+
+	if (tf->transpositions_ok && ! tf->osa) {
+	    d = search_trans_distance (tf, int_distance, tf->text.ulength);
 	}
 	else {
-	    misses++;
-	    MESSAGE (" out of bounds.\n");
+	    k = 1;
+	    if (use_wavefront (tf, tf->text.ulength)) {
+		d = distance_wavefront_int (tf);
+		if (d >= 0) {
+		    return d;
+		}
+		k = tf->text.ulength / WAVEFRONT_LENGTH_RATIO + 1;
+	    }
+	    d = search_distance (tf, int_distance, k, tf->text.ulength);
 	}
+	if (d >= 0) {
+	    return d;
+	}
+    }
+    if (tf->transpositions_ok && ! (tf->osa && tf->masks.chars)) {
+	MESSAGE ("Transpositions OK.\n");
+	return distance_int_trans (tf);
+    }
+    if (! tf->transpositions_ok && use_diagonals (tf, tf->text.ulength)) {
+	return distance_diagonal_int (tf);
+    }
+    if (tf->masks.masks) {
 
-	/* If we have too many misses, stop searching. */
+	/* This also computes the optimal string alignment distance
+	   if "tf->osa" is set. */
 
-	if (misses >= tf->max_distance) {
-	    MESSAGE ("%s:%s: %d misses over %d: ",
-		    tf->text.text, tf->b.text, misses, tf->max_distance);
-	    return 1;
+	return distance_bits_blocks_int (tf);
+    }
+    if (tf->masks.chars) {
+
+	/* There are too many different characters in the search term
+	   for its match masks, so make masks of only the characters
+	   in both strings. */
+
+	return distance_bits_pair_int (tf);
+    }
+    MESSAGE ("No transpositions.\n");
+    return distance_int (tf);
+}
+
+/* The edit distance between the byte strings "tf->text" and "tf->b",
+   after "strip_affixes", using whichever algorithm suits them and the
+   maximum distance. */
+
+static int
+char_distance (text_fuzzy_t * tf)
+{
+    if (use_within (tf)) {
+	return (* within_char[tf->max_distance]) (tf);
+    }
+    if (use_search (tf, tf->text.length)) {
+	int d;
+	int k;
+
+	if (tf->transpositions_ok && ! tf->osa) {
+	    d = search_trans_distance (tf, char_distance, tf->text.length);
+	}
+	else {
+	    k = 1;
+	    if (use_wavefront (tf, tf->text.length)) {
+		d = distance_wavefront_char (tf);
+		if (d >= 0) {
+		    return d;
+		}
+		k = tf->text.length / WAVEFRONT_LENGTH_RATIO + 1;
+	    }
+	    d = search_distance (tf, char_distance, k, tf->text.length);
+	}
+	if (d >= 0) {
+	    return d;
 	}
     }
-    return 0;
+    if (tf->transpositions_ok &&
+	! (tf->osa && (tf->use_bits || tf->masks.masks))) {
+	return distance_char_trans (tf);
+    }
+    if (! tf->transpositions_ok && use_diagonals (tf, tf->text.length)) {
+	return distance_diagonal_char (tf);
+    }
+    if (tf->use_bits) {
+
+	/* The search term fits into a machine word, so use the
+	   bit-parallel algorithm. This and the blocked version below
+	   also compute the optimal string alignment distance if
+	   "tf->osa" is set. */
+
+	return distance_bits_char (tf);
+    }
+    if (tf->masks.masks) {
+	return distance_bits_blocks_char (tf);
+    }
+    return distance_char (tf);
 }
 
-/* This is a value for the edit distance which indicates complete
-   failure to match. */
+/* Put at least "size" bytes of the scratch memory "w" of "tf" into
+   "* mem_ptr". It grows by at least doubling, so a list of strings of
+   increasing length does not allocate it again for each one. */
 
-#define NOT_FOUND -1
+STATIC FUNC (grow_workspace) (text_fuzzy_t * tf, text_fuzzy_workspace_t * w,
+			      int size, void ** mem_ptr)
+{
+    if (size > w->size) {
+	int new_size;
 
-#define LENGTH_REJECT(x,y)						\
-    MESSAGE ("Length of %d can never match %d within %d edits",		\
-	     (x), (y), tf->max_distance);				\
-    tf->length_rejections++
+	new_size = size;
+	if (w->size < INT_MAX / 2 && 2 * w->size > new_size) {
+	    new_size = 2 * w->size;
+	}
+	if (w->mem) {
+	    /* The old contents are not needed, so there is no point
+	       in "realloc" copying them. */
+	    free (w->mem);
+	    tf->n_mallocs--;
+	    w->mem = 0;
+	    w->size = 0;
+	}
+	w->mem = malloc (new_size);
+	FAIL (! w->mem, memory_error);
+	tf->n_mallocs++;
+	w->size = new_size;
+    }
+    * mem_ptr = w->mem;
+    OK;
+}
+
+/* Put at least "size" bytes of scratch memory for the edit distance
+   calculations into "* mem_ptr". The memory belongs to "tf" and is
+   reused by the next calculation, so it is only valid until then. */
+
+FUNC (workspace) (text_fuzzy_t * tf, int size, void ** mem_ptr)
+{
+    CALL (grow_workspace (tf, & tf->workspace, size, mem_ptr));
+    OK;
+}
+
+/* Put at least "size" bytes of scratch memory for match masks into
+   "* mem_ptr". This is separate from "text_fuzzy_workspace", so the
+   masks stay valid while the edit distance calculation uses that. */
 
+FUNC (masks_workspace) (text_fuzzy_t * tf, int size, void ** mem_ptr)
+{
+    CALL (grow_workspace (tf, & tf->masks_workspace, size, mem_ptr));
+    OK;
+}
+
+/* If we have found something, and either it is less than or equal
+   to the maximum distance allowed, or we are not checking for
+   maximum distance, then record this distance and switch on the
+   "found" flag, "tf->found". */
+
+STATIC FUNC (record_distance) (text_fuzzy_t * tf, int d)
+{
+    if (d != NOT_FOUND && (tf->max_distance == NO_MAX_DISTANCE ||
+			   d <= tf->max_distance)) {
+	if (tf->no_exact) {
+
+	    /* Skip exact matches. */
+
+	    if (d == 0) {
+		OK;
+	    }
+	}
+	tf->found = 1;
+	tf->distance = d;
+	if (tf->scanning) {
+	    tf->max_distance = tf->distance;
+	}
+	/* "wantarray" stays set after "nearest" in list context, so
+	   check "scanning" too, otherwise "distance" after it adds to
+	   the list which "get_candidates" freed. */
+
+	if (tf->scanning && tf->wantarray) {
+	    candidate_t * c;
+	    c = malloc (sizeof (candidate_t));
+	    FAIL (! c, memory_error);
+	    tf->n_mallocs+=1;
+	    c->distance = d;
+	    c->offset = tf->offset;
+	    c->next = 0;
+	    tf->last->next = c;
+	    tf->last = c;
+	}
+    }
+    OK;
+}
 
 /* Compare tf and b. This goes through a series of filters which
    reject impossible matches, and then if none of the filters applies,
@@ -546,12 +1594,29 @@ FUNC (compare_single) (text_fuzzy_t * tf)
 
     int d;
 
+    /* The search term and the string to compare it with, before
+       "strip_affixes". */
+
+    text_fuzzy_string_t text;
+    text_fuzzy_string_t b;
+
     d = NOT_FOUND;
 
     tf->found = 0;
 
     if (tf->unicode) {
 
+	/* Count the characters of "b" without decoding them, since
+	   the filters below may reject it. */
+
+	if (tf->b_utf8) {
+	    tf->b.ulength = utf8_n_chars ((const unsigned char *) tf->b.text,
+					  tf->b.length);
+	}
+	else {
+	    tf->b.ulength = tf->b.length;
+	}
+
 	if (tf->max_distance != NO_MAX_DISTANCE) {
 
 	    /* Filter on distance: If the distance in the length of
@@ -567,23 +1632,32 @@ FUNC (compare_single) (text_fuzzy_t * tf)
 		OK;
 	    }
 	    if (tf->use_ualphabet) {
+		int limit;
+
+		/* The same filter as in "bytes_rejected", with the
+		   counts of the characters. */
+
+		limit = tf->max_distance;
+		if (tf->text.ulength > tf->b.ulength) {
+		    limit -= tf->text.ulength - tf->b.ulength;
+		}
 
 		/*
-		  Check that the length of "b" is more than the maximum
-		  distance, otherwise the alphabet check will not reject
-		  "b" regardless of the alphabet difference found, since
-		  the largest possible value of "misses" in the alphabet
+		  Check that the length of "b" is more than the limit,
+		  otherwise the alphabet check will not reject "b"
+		  regardless of the alphabet difference found, since
+		  the largest possible excess in the alphabet
 		  check is the total number of characters in "b".
 		*/
 
-		if (tf->b.ulength > tf->max_distance) {
+		if (tf->b.ulength > limit) {
 
 		    /* Filter using alphabet: If the number of
-		       characters in "b" which are not in "tf->text"
-		       is greater than the maximum distance, give
-		       up. */
+		       characters in "b" in excess of those in
+		       "tf->text" shows that the distance is greater
+		       than the maximum distance, give up. */
 
-		    if (ualphabet_miss (tf, & tf->b)) {
+		    if (ualphabet_miss (tf, & tf->b, limit)) {
 
 			MESSAGE ("Rejected.\n");
 
@@ -596,8 +1670,8 @@ FUNC (compare_single) (text_fuzzy_t * tf)
 		    }
 		}
 		else {
-		    MESSAGE ("%s: skipping alphabet check because len %d <= max %d.\n",
-			     tf->b.text, tf->b.ulength, tf->max_distance);
+		    MESSAGE ("%s: skipping alphabet check because len %d <= limit %d.\n",
+			     tf->b.text, tf->b.ulength, limit);
 		}
 	    }
 	}
@@ -605,104 +1679,88 @@ FUNC (compare_single) (text_fuzzy_t * tf)
 	/* Calculate edit distances using the dynamic programming
 	   algorithm for the integer Unicode strings. */
 
-	if (tf->transpositions_ok) {
-	    MESSAGE ("Transpositions OK.\n");
-	    d = distance_int_trans (tf);
-	}
-	else {
-	    MESSAGE ("No transpositions.\n");
-	    d = distance_int (tf);
+	b_decode (tf);
+	if (tf->use_qgrams && tf->max_distance != NO_MAX_DISTANCE &&
+	    qgrams_rejected (tf, 0, tf->b.unicode, tf->b.ulength,
+			     tf->text.ulength)) {
+	    tf->qgram_rejections++;
+	    OK;
 	}
+	strip_affixes (tf, & text, & b);
+	d = int_distance (tf);
+	restore_affixes (tf, & text, & b);
     }
     else {
 
 	/* This is not Unicode. */
 
-        if (tf->max_distance != NO_MAX_DISTANCE) {
-
-            /* If the distance in the length of the strings is greater
-               than the max distance, give up. */
-
-            if (abs (tf->text.length - tf->b.length) > tf->max_distance) {
-
-		LENGTH_REJECT (tf->b.length, tf->text.length);
-	    
-                OK;
-            }
-
-	    /* See comment in the Unicode version, above. */
-
-	    if (tf->b.length > tf->max_distance) {
-
-		/* Alphabet filter: eliminate terms which cannot match. */
-
-		if (tf->use_alphabet) {
-		    int alphabet_misses;
-		    int l;
-
-		    alphabet_misses = 0;
-
-		    for (l = 0; l < tf->b.length; l++) {
-
-			int a = (unsigned char) tf->b.text[l];
-
-			if (! tf->alphabet[a]) {
-			    alphabet_misses++;
-			    if (alphabet_misses > tf->max_distance) {
-
-				/* It is not possible that the two words
-				   are within the maximum edit distance of
-				   each other. */
+	if (bytes_rejected (tf)) {
+	    OK;
+	}
 
-				tf->alphabet_rejections++;
-				OK;
-			    }
-			}
-		    }
-		}
-	    }
-        }
         /* Calculate the edit distance using the dynamic programming
 	   algorithm for "unsigned char". */
 
-	if (tf->transpositions_ok) {
-	    d = distance_char_trans (tf);
-	}
-	else {
-	    d = distance_char (tf);
-	}
+	strip_affixes (tf, & text, & b);
+	d = char_distance (tf);
+	restore_affixes (tf, & text, & b);
     }
 
-    /* If we have found something, and either it is less than or equal
-       to the maximum distance allowed, or we are not checking for
-       maximum distance, then record this distance and switch on the
-       "found" flag, "tf->found". */
+    CALL (record_distance (tf, d));
+    OK;
+}
 
-    if (d != NOT_FOUND && (tf->max_distance == NO_MAX_DISTANCE ||
-			   d <= tf->max_distance)) {
-	if (tf->no_exact) {
+/* Compare the search term with the "n_words" byte strings in
+   "words", with the same results as calling
+   "text_fuzzy_compare_single" on each of them in turn, with
+   "tf->offset" counting up from "offset". This is only for non-Unicode
+   search terms in "tf->peq", without transpositions.
+
+   The words are filtered, and their edit distances computed
+   together by "distance_simd_batch", using the maximum distance from
+   before the first word, and then they are recorded in order, so a
+   word whose edit distance is over a maximum distance reduced by an
+   earlier word in the batch is still rejected.
+
+   "* nearest_ptr" is set to the offset of the last word found, and
+   is not changed if no word is found. If we do not want an array of
+   answers, the comparison stops at the first exact match, and
+   "* stop_ptr" is set to 1. Otherwise it is set to 0. */
+
+FUNC (compare_batch) (text_fuzzy_t * tf, const text_fuzzy_string_t * words,
+		      int n_words, int offset, int * nearest_ptr,
+		      int * stop_ptr)
+{
+    /* The words which passed the filters. */
 
-	    /* Skip exact matches. */
+    int todo[BATCH_MAX_WORDS];
+    int n_todo;
+    int distances[BATCH_MAX_WORDS];
+    int i;
 
-	    if (d == 0) {
-		OK;
-	    }
-	}
-	tf->found = 1;
-	tf->distance = d;
-	if (tf->scanning) {
-	    tf->max_distance = tf->distance;
+    FAIL (n_words > BATCH_MAX_WORDS, miscount);
+    * stop_ptr = 0;
+    n_todo = 0;
+    for (i = 0; i < n_words; i++) {
+	distances[i] = NOT_FOUND;
+	tf->b.text = words[i].text;
+	tf->b.length = words[i].length;
+	if (! bytes_rejected (tf)) {
+	    todo[n_todo] = i;
+	    n_todo++;
 	}
-	if (tf->wantarray) {
-	    candidate_t * c;
-	    c = malloc (sizeof (candidate_t));
-	    FAIL (! c, memory_error);
-	    tf->n_mallocs+=1;
-	    c->distance = d;
-	    c->offset = tf->offset;
-	    c->next = 0;
-	    tf->last->next = c;
-	    tf->last = c;
+    }
+    distance_simd_batch (tf, words, todo, n_todo, distances);
+    for (i = 0; i < n_words; i++) {
+	tf->found = 0;
+	tf->offset = offset + i;
+	CALL (record_distance (tf, distances[i]));
+	if (tf->found) {
+	    * nearest_ptr = offset + i;
+	    if (! tf->wantarray && tf->distance == 0) {
+		* stop_ptr = 1;
+		break;
+	    }
 	}
     }
     OK;
@@ -776,38 +1834,50 @@ FUNC (free_candidates) (text_fuzzy_t * text_fuzzy, int * candidates)
 }
 
 
-/* This is the threshold above which we do not bother computing the
-   alphabet of the string. If it has more than this number of unique
-   characters, the alphabet will not reduce the search time by
-   much. */
-
-static int max_unique_characters = 45;
-
 /* Generate an alphabet from the search word, which is used to filter
    non-matching terms without using the dynamic programming
    algorithm. */
 
 FUNC (generate_alphabet) (text_fuzzy_t * text_fuzzy)
 {
-    int unique_characters;
     int i;
 
+    /* Even a search term with many different bytes has an alphabet
+       filter, since "filter_result" skips the filter while it is not
+       rejecting anything. */
+
     text_fuzzy->use_alphabet = 1;
 
     for (i = 0; i < 0x100; i++) {
         text_fuzzy->alphabet[i] = 0;
     }
-    unique_characters = 0;
+    for (i = 0; i < 0x20; i++) {
+        text_fuzzy->alphabet_mask[i] = 0;
+    }
     for (i = 0; i < text_fuzzy->text.length; i++) {
         int c;
         c = (unsigned char) text_fuzzy->text.text[i];
-        if (! text_fuzzy->alphabet[c]) {
-            unique_characters++;
-            text_fuzzy->alphabet[c] = 1;
-        }
+        text_fuzzy->alphabet[c]++;
+        text_fuzzy->alphabet_mask[(c >> 7) * 16 + (c & 15)] |=
+	    1 << ((c >> 4) & 7);
     }
-    if (unique_characters > max_unique_characters) {
-        text_fuzzy->use_alphabet = 0;
+
+    /* Make the match masks for the bit-parallel edit distance, if
+       the search term fits into one machine word. */
+    text_fuzzy->use_bits = 0;
+    if (text_fuzzy->text.length <= TEXT_FUZZY_BITS) {
+	for (i = 0; i < 0x100; i++) {
+	    text_fuzzy->peq[i] = 0;
+	}
+	for (i = 0; i < text_fuzzy->text.length; i++) {
+	    int c;
+	    c = (unsigned char) text_fuzzy->text.text[i];
+	    text_fuzzy->peq[c] |= ((text_fuzzy_bits_t) 1) << i;
+	}
+	text_fuzzy->use_bits = 1;
+    }
+    else {
+	CALL (generate_masks (text_fuzzy));
     }
     /* Find an unused slot. This is for the case where the string to
        match is not in Unicode, but the string which it is matched
@@ -818,6 +1888,7 @@ FUNC (generate_alphabet) (text_fuzzy_t * text_fuzzy)
 	    break;
 	}
     }
+    CALL (generate_qgrams (text_fuzzy));
     OK;
 }
 
@@ -842,11 +1913,17 @@ FUNC (begin_scanning) (text_fuzzy_t * text_fuzzy)
     text_fuzzy->distance = -1;
     text_fuzzy->ualphabet.rejections = 0;
     text_fuzzy->alphabet_rejections = 0;
+    text_fuzzy->qgram_rejections = 0;
     text_fuzzy->length_rejections = 0;
+    memset (& text_fuzzy->alphabet_filter, 0, sizeof (text_fuzzy_filter_t));
+    memset (& text_fuzzy->qgram_filter, 0, sizeof (text_fuzzy_filter_t));
 
-    /* Set up the linked list. */
+    /* Set up the linked list. "get_candidates" freed the entries of
+       the previous search, so "first.next" must not point to them if
+       this search finds nothing. */
 
     if (text_fuzzy->wantarray) {
+	text_fuzzy->first.next = 0;
 	text_fuzzy->last = & text_fuzzy->first;
     }
 
@@ -1015,8 +2092,28 @@ FUNC (alphabet_rejections) (text_fuzzy_t * text_fuzzy, int * r)
 
 FUNC (free_memory) (text_fuzzy_t * text_fuzzy)
 {
-    if (text_fuzzy->ualphabet.alphabet) {
-	free (text_fuzzy->ualphabet.alphabet);
+    if (text_fuzzy->ualphabet.counts) {
+	free (text_fuzzy->ualphabet.counts);
+	text_fuzzy->n_mallocs--;
+    }
+    if (text_fuzzy->qgrams) {
+	free (text_fuzzy->qgrams);
+	text_fuzzy->n_mallocs--;
+    }
+    if (text_fuzzy->masks.masks) {
+	free (text_fuzzy->masks.masks);
+	text_fuzzy->n_mallocs--;
+    }
+    if (text_fuzzy->masks.chars) {
+	free (text_fuzzy->masks.chars);
+	text_fuzzy->n_mallocs--;
+    }
+    if (text_fuzzy->workspace.mem) {
+	free (text_fuzzy->workspace.mem);
+	text_fuzzy->n_mallocs--;
+    }
+    if (text_fuzzy->masks_workspace.mem) {
+	free (text_fuzzy->masks_workspace.mem);
 	text_fuzzy->n_mallocs--;
     }
     OK;
@@ -1037,12 +2134,18 @@ FUNC (get_max_distance) (text_fuzzy_t * text_fuzzy, int * max_distance)
 FUNC (set_transpositions) (text_fuzzy_t * text_fuzzy, int transpositions)
 {
     text_fuzzy->transpositions_ok = transpositions != 0 ? 1 : 0;
+    text_fuzzy->osa = transpositions == TEXT_FUZZY_TRANS_OSA ? 1 : 0;
     OK;
 }
 
 FUNC (get_transpositions) (text_fuzzy_t * text_fuzzy, int * transpositions)
 {
-    * transpositions = text_fuzzy->transpositions_ok;
+    if (text_fuzzy->osa) {
+	* transpositions = TEXT_FUZZY_TRANS_OSA;
+    }
+    else {
+	* transpositions = text_fuzzy->transpositions_ok;
+    }
     OK;
 }
 
@@ -1058,6 +2161,7 @@ FUNC (no_alphabet) (text_fuzzy_t * text_fuzzy, int yes_no)
     if (text_fuzzy->user_no_alphabet) {
 	text_fuzzy->use_alphabet = 0;
 	text_fuzzy->use_ualphabet = 0;
+	text_fuzzy->use_qgrams = 0;
     }
     OK;
 }
@@ -1068,6 +2172,12 @@ FUNC (ualphabet_rejections) (text_fuzzy_t * text_fuzzy, int * ualphabet_rejectio
     OK;
 }
 
+FUNC (qgram_rejections) (text_fuzzy_t * text_fuzzy, int * qgram_rejections)
+{
+    * qgram_rejections = text_fuzzy->qgram_rejections;
+    OK;
+}
+
 FUNC (set_no_exact) (text_fuzzy_t * text_fuzzy, int yes_no)
 {
     text_fuzzy->no_exact = yes_no != 0 ? 1 : 0;
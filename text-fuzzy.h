@@ -92,21 +92,44 @@ static int max_distance_misuse = text_fuzzy_status_max_distance_misuse;
 static int miscount = text_fuzzy_status_miscount;
 #endif /* __GNUC__ */
 
-/* Alphabet over unicode characters. */
+/* A machine word used as a bit vector by the bit-parallel edit
+   distance algorithms in "edit-distance-bits.c". */
 
-typedef struct ualphabet {
+#ifdef _MSC_VER
+typedef unsigned __int64 text_fuzzy_bits_t;
+#else /* _MSC_VER */
+typedef unsigned long long text_fuzzy_bits_t;
+#endif /* _MSC_VER */
 
-    /* The smallest character in our alphabet. */
-    int min;
+/* The number of bits in "text_fuzzy_bits_t". */
 
-    /* The largest character in our alphabet. */
-    int max;
+#define TEXT_FUZZY_BITS 64
 
-    /* Number of chars allocated in the following array. */
-    int size;
+/* The number of bits in the signature of a Unicode alphabet, and the
+   bit for character "c". This multiplies by a different number from
+   "TEXT_FUZZY_CHAR_HASH", so that characters which are near each
+   other in the hash table do not also share a bit. */
+
+#define TEXT_FUZZY_SIGNATURE_BITS 256
+#define TEXT_FUZZY_SIGNATURE_BIT(c) \
+    ((((unsigned int) (c)) * 0x85EBCA6BU) >> 24)
+
+/* Alphabet over unicode characters. */
+
+typedef struct ualphabet {
+
+    /* The number of times each character occurs in the search term,
+       indexed by the character's row in the hash table of the match
+       masks. Row zero, for characters which are not in the search
+       term, is always zero. */
+    int * counts;
 
-    /* Array containing Unicode alphabet, as a bitmap. */
-    unsigned char * alphabet;
+    /* A signature of the characters of the search term, with the bit
+       "TEXT_FUZZY_SIGNATURE_BIT" of each one set. Most characters
+       which are not in the search term have a clear bit, which shows
+       that they are not in it without looking them up in the hash
+       table. */
+    text_fuzzy_bits_t signature[TEXT_FUZZY_SIGNATURE_BITS / TEXT_FUZZY_BITS];
 
     /* The number of characters which were rejected using the Unicode
        alphabet. */
@@ -114,6 +137,141 @@ typedef struct ualphabet {
 }
 ualphabet_t;
 
+/* How much one of the filters which look at the characters of each
+   string has rejected lately. A filter which rejects few strings is
+   skipped for a while, so that it does not cost time on lists which
+   it does not help with, and then tried again, in case the list has
+   changed. */
+
+typedef struct text_fuzzy_filter {
+
+    /* The number of strings which the filter looked at, and which it
+       rejected, since it was last judged. */
+    int tries;
+    int rejections;
+
+    /* The number of strings still to let past without looking at
+       them. */
+    int skip;
+}
+text_fuzzy_filter_t;
+
+/* A slot of the hash table of the characters of a Unicode search
+   term. */
+
+typedef struct text_fuzzy_char {
+
+    /* The character, or -1 for an empty slot. */
+    int c;
+
+    /* The number of the match mask of "c". */
+    int row;
+}
+text_fuzzy_char_t;
+
+/* The first slot to look for Unicode character "c" in a hash table
+   of "1 << (32 - shift)" slots. This multiplies by a number near
+   2^32 divided by the golden ratio and takes the top bits, so that
+   runs of consecutive characters, such as kana, spread out. */
+
+#define TEXT_FUZZY_CHAR_HASH(c, shift) \
+    ((((unsigned int) (c)) * 0x9E3779B1U) >> (shift))
+
+/* The bit for the trigram of characters "c", "d" and "e" in a
+   bitmap of "1 << (32 - shift)" bits. Trigrams which share a bit
+   only make the q-gram filter reject fewer strings. */
+
+#define TEXT_FUZZY_QGRAM_HASH(c, d, e, shift)				\
+    TEXT_FUZZY_CHAR_HASH ((((unsigned int) (c)) * 0x9E3779B1U +	\
+			   (unsigned int) (d)) * 0x9E3779B1U +		\
+			  (unsigned int) (e), shift)
+
+/* Byte "c" of the alphabet mask "mask" is bit "(c >> 4) & 7" of
+   "mask[(c >> 7) * 16 + (c & 15)]". */
+
+#define TEXT_FUZZY_ALPHABET_BIT(mask, c)				\
+    (((mask)[((c) >> 7) * 16 + ((c) & 15)] >> (((c) >> 4) & 7)) & 1)
+
+/* Match masks of the search term for the blocked bit-parallel edit
+   distance, which is used for search terms which do not fit into one
+   machine word, and for Unicode search terms. */
+
+typedef struct text_fuzzy_masks {
+
+    /* The number of machine words in each match mask. */
+    int n_blocks;
+
+    /* The number of different characters in the search term. */
+    int n_chars;
+
+    /* The match masks, "n_blocks" words per character. The first
+       mask is all zeros, for characters not in the search term. */
+    text_fuzzy_bits_t * masks;
+
+    /* For byte strings, the number of the mask of each byte in
+       "masks". */
+    unsigned short row[0x100];
+
+    /* For Unicode strings, the different characters of the search
+       term in a hash table with open addressing. It has "n_slots"
+       slots, a power of two, at least twice the number of
+       characters, so there are always empty slots. Look up a
+       character "c" from slot "TEXT_FUZZY_CHAR_HASH (c, shift)",
+       moving to the next slot until finding "c" or an empty slot,
+       which has the character -1 and mask number zero. */
+    text_fuzzy_char_t * chars;
+    int n_slots;
+    int shift;
+}
+text_fuzzy_masks_t;
+
+/* "inline" for the lookups below, which are called for every
+   character. */
+
+#ifdef _MSC_VER
+#define TEXT_FUZZY_INLINE __inline
+#else /* _MSC_VER */
+#define TEXT_FUZZY_INLINE inline
+#endif /* _MSC_VER */
+
+/* The slot of Unicode character "c" in the hash table of "m", or the
+   empty slot where it would go if it is not in the search term. */
+
+static TEXT_FUZZY_INLINE unsigned int
+text_fuzzy_char_slot (const text_fuzzy_masks_t * m, int c)
+{
+    unsigned int slot;
+
+    slot = TEXT_FUZZY_CHAR_HASH (c, m->shift);
+    while (m->chars[slot].c != c && m->chars[slot].c >= 0) {
+	slot = (slot + 1) & (m->n_slots - 1);
+    }
+    return slot;
+}
+
+/* The row of Unicode character "c" in the hash table of "m", which
+   is zero if "c" is not in the search term. */
+
+static TEXT_FUZZY_INLINE int
+text_fuzzy_char_row (const text_fuzzy_masks_t * m, int c)
+{
+    return m->chars[text_fuzzy_char_slot (m, c)].row;
+}
+
+/* Scratch memory for the edit distance calculations. This is kept
+   from one comparison to the next, so that comparing a list of
+   strings does not allocate memory for each one. */
+
+typedef struct text_fuzzy_workspace {
+
+    /* The memory, or zero if none has been allocated yet. */
+    void * mem;
+
+    /* The number of bytes allocated to "mem". */
+    int size;
+}
+text_fuzzy_workspace_t;
+
 /* This structure contains one string of whatever type. */
 
 typedef struct text_fuzzy_string {
@@ -166,9 +324,42 @@ typedef struct text_fuzzy {
     /* The number of mallocs we are guilty of. */
     int n_mallocs;
 
-    /* ASCII alphabet */
+    /* ASCII alphabet, the number of times each byte occurs in the
+       search term. */
     int alphabet[0x100];
 
+    /* The bytes of the search term as a 256-bit mask. Byte "c" is
+       "TEXT_FUZZY_ALPHABET_BIT (alphabet_mask, c)", which is laid out
+       so that a SIMD shuffle can look up sixteen bytes at once. */
+    unsigned char alphabet_mask[0x20];
+
+    /* Match masks of the search term for the bit-parallel edit
+       distance. Bit "i" of "peq[c]" is set if byte "i" of "text" is
+       "c". These are only valid if "use_bits" is set. */
+    text_fuzzy_bits_t peq[0x100];
+
+    /* Match masks for the blocked bit-parallel edit distance. These
+       are only valid if "masks.masks" is not zero. */
+    text_fuzzy_masks_t masks;
+
+    /* Scratch memory for the edit distance calculations. */
+    text_fuzzy_workspace_t workspace;
+
+    /* Scratch memory for match masks made for one comparison, which
+       are used at the same time as "workspace". */
+    text_fuzzy_workspace_t masks_workspace;
+
+    /* The number of characters at the start of "text" and "b" which
+       were the same, and have been removed for the edit distance
+       calculation. The match masks are still those of the whole of
+       "text". */
+    int prefix;
+
+    /* The number of characters of "b" which the blocked bit-parallel
+       edit distance got through before every cell was over the
+       maximum distance, or zero if it did not give up part way. */
+    int stopped;
+
     /* The number of characters which were rejected using the ASCII
        alphabet. */
     int alphabet_rejections;
@@ -176,6 +367,22 @@ typedef struct text_fuzzy {
     /* Unicode alphabet. */
     ualphabet_t ualphabet;
 
+    /* The trigrams of the search term for the q-gram filter, as a
+       bitmap of "1 << (32 - qgram_shift)" bits, with the bit
+       "TEXT_FUZZY_QGRAM_HASH" of each trigram set. */
+    unsigned char * qgrams;
+    int qgram_shift;
+
+    /* The number of strings which were rejected using the q-gram
+       filter. */
+    int qgram_rejections;
+
+    /* How the alphabet filters and the q-gram filter are doing in
+       this scan. The byte and Unicode alphabet filters share
+       "alphabet_filter", since only one of them is used. */
+    text_fuzzy_filter_t alphabet_filter;
+    text_fuzzy_filter_t qgram_filter;
+
     /* The minimum distance we got in our most recent effort. */
     int distance;
 
@@ -217,6 +424,11 @@ typedef struct text_fuzzy {
        user does not want to use it.) */
     unsigned int use_alphabet : 1;
     unsigned int use_ualphabet : 1;
+    unsigned int use_qgrams : 1;
+
+    /* Does "peq" contain the match masks of "text"? This is true if
+       "text" is not Unicode and fits into a single machine word. */
+    unsigned int use_bits : 1;
 
     /* Variable edit costs? (currently unused) */
     unsigned int variable_edit_costs : 1;
@@ -224,12 +436,23 @@ typedef struct text_fuzzy {
     /* Do we account for transpositions? */
     unsigned int transpositions_ok : 1;
 
+    /* If transpositions are allowed, do we use the optimal string
+       alignment distance rather than the Damerau-Levenshtein
+       distance? */
+    unsigned int osa : 1;
+
     /* Did we find it? */
     unsigned int found : 1;
 
     /* Is this Unicode? */
     unsigned int unicode : 1;
 
+    /* Is "b.text" UTF-8, rather than bytes which are the characters?
+       This is only used if "unicode" is set. "b.unicode" is made from
+       "b.text" by "text_fuzzy_compare_single" if "b" gets past the
+       filters. */
+    unsigned int b_utf8 : 1;
+
     /* Do we want to skip exact matches? */
     unsigned int no_exact : 1;
 
@@ -241,6 +464,12 @@ typedef struct text_fuzzy {
 }
 text_fuzzy_t;
 
+/* The value of "transpositions" for
+   "text_fuzzy_set_transpositions" which selects the optimal string
+   alignment distance. */
+
+#define TEXT_FUZZY_TRANS_OSA 2
+
 /* The string is not unicode so its length in unicode characters is
    unknown. */
 
@@ -248,7 +477,10 @@ text_fuzzy_t;
 #line 191 "/usr/home/ben/projects/Text-Fuzzy/text-fuzzy.c.in"
 text_fuzzy_status_t text_fuzzy_generate_ualphabet (text_fuzzy_t * tf);
 #line 376 "/usr/home/ben/projects/Text-Fuzzy/text-fuzzy.c.in"
+text_fuzzy_status_t text_fuzzy_workspace (text_fuzzy_t * tf, int size, void ** mem_ptr);
+text_fuzzy_status_t text_fuzzy_masks_workspace (text_fuzzy_t * tf, int size, void ** mem_ptr);
 text_fuzzy_status_t text_fuzzy_compare_single (text_fuzzy_t * tf);
+text_fuzzy_status_t text_fuzzy_compare_batch (text_fuzzy_t * tf, const text_fuzzy_string_t * words, int n_words, int offset, int * nearest_ptr, int * stop_ptr);
 #line 553 "/usr/home/ben/projects/Text-Fuzzy/text-fuzzy.c.in"
 text_fuzzy_status_t text_fuzzy_get_candidates (text_fuzzy_t * text_fuzzy, int * n_candidates_ptr, int ** candidates_ptr);
 #line 610 "/usr/home/ben/projects/Text-Fuzzy/text-fuzzy.c.in"
@@ -279,6 +511,7 @@ text_fuzzy_status_t text_fuzzy_last_distance (text_fuzzy_t * text_fuzzy, int * l
 text_fuzzy_status_t text_fuzzy_no_alphabet (text_fuzzy_t * text_fuzzy, int yes_no);
 #line 895 "/usr/home/ben/projects/Text-Fuzzy/text-fuzzy.c.in"
 text_fuzzy_status_t text_fuzzy_ualphabet_rejections (text_fuzzy_t * text_fuzzy, int * ualphabet_rejections);
+text_fuzzy_status_t text_fuzzy_qgram_rejections (text_fuzzy_t * text_fuzzy, int * qgram_rejections);
 #line 901 "/usr/home/ben/projects/Text-Fuzzy/text-fuzzy.c.in"
 text_fuzzy_status_t text_fuzzy_set_no_exact (text_fuzzy_t * text_fuzzy, int yes_no);
 #line 907 "/usr/home/ben/projects/Text-Fuzzy/text-fuzzy.c.in"
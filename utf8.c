@@ -0,0 +1,151 @@
+/* Counting and decoding the characters of UTF-8 strings.
+
+   These do not check that the UTF-8 is valid, since Perl has already
+   done that for strings which are marked as UTF-8. They count a
+   character for each byte which is not a continuation byte, of the
+   form 10xxxxxx, and decode a character from each of those bytes and
+   the continuation bytes which follow it, so they agree about the
+   number of characters whatever the bytes are.
+
+   "utf8_decode_chars" copies runs of ASCII sixteen bytes at a time
+   with SSE2 instructions, and decodes the other characters one by
+   one. */
+
+#include <string.h>
+
+#include "config.h"
+#include "text-fuzzy.h"
+#include "utf8.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* The bytes of a machine word which are continuation bytes of UTF-8
+   have this bit set after "x & ~ (x << 1)". */
+
+#define UTF8_CONTINUATION_BITS ((text_fuzzy_bits_t) 0x8080808080808080ULL)
+
+/* The number of characters in the UTF-8 string "s" of "n" bytes. This
+   looks at a machine word at a time. */
+
+int utf8_n_chars (const unsigned char * s, int n)
+{
+    int continuations;
+    int i;
+
+    continuations = 0;
+    i = 0;
+    while (i + (int) sizeof (text_fuzzy_bits_t) <= n) {
+	text_fuzzy_bits_t x;
+
+	memcpy (& x, s + i, sizeof (x));
+	x = (x & ~ (x << 1) & UTF8_CONTINUATION_BITS) >> 7;
+
+	/* Add up the bytes of "x", which are each zero or one. */
+
+	continuations += (x * (text_fuzzy_bits_t) 0x0101010101010101ULL) >> 56;
+	i += sizeof (text_fuzzy_bits_t);
+    }
+    while (i < n) {
+	if ((s[i] & 0xC0) == 0x80) {
+	    continuations++;
+	}
+	i++;
+    }
+    return n - continuations;
+}
+
+/* Decode the UTF-8 character at "* s_ptr", which is before "end", and
+   move "* s_ptr" to the start of the next character. */
+
+int utf8_next_char (const unsigned char ** s_ptr,
+		    const unsigned char * end)
+{
+    const unsigned char * s;
+    unsigned int c;
+
+    s = * s_ptr;
+    c = * s++;
+    if (c >= 0xC0) {
+	if (c < 0xE0) {
+	    c &= 0x1F;
+	}
+	else if (c < 0xF0) {
+	    c &= 0x0F;
+	}
+	else {
+	    c &= 0x07;
+	}
+	while (s < end && (* s & 0xC0) == 0x80) {
+	    c = (c << 6) | (* s & 0x3F);
+	    s++;
+	}
+    }
+    * s_ptr = s;
+    return (int) c;
+}
+
+/* Decode the UTF-8 string "s" of "n" bytes into "chars", which has
+   room for "n" characters. The return value is the number of
+   characters. */
+
+int utf8_decode_chars (const unsigned char * s, int n, int * chars)
+{
+    const unsigned char * end;
+    int i;
+
+    end = s + n;
+    i = 0;
+    while (s < end) {
+#ifdef __SSE2__
+	if (end - s >= 16) {
+	    __m128i x;
+
+	    x = _mm_loadu_si128 ((const __m128i *) s);
+	    if (_mm_movemask_epi8 (x) == 0) {
+
+		/* Sixteen ASCII bytes, which are the characters. Widen
+		   them to 32 bits. */
+
+		__m128i zero;
+		__m128i lo;
+		__m128i hi;
+
+		zero = _mm_setzero_si128 ();
+		lo = _mm_unpacklo_epi8 (x, zero);
+		hi = _mm_unpackhi_epi8 (x, zero);
+		_mm_storeu_si128 ((__m128i *) (chars + i),
+				  _mm_unpacklo_epi16 (lo, zero));
+		_mm_storeu_si128 ((__m128i *) (chars + i + 4),
+				  _mm_unpackhi_epi16 (lo, zero));
+		_mm_storeu_si128 ((__m128i *) (chars + i + 8),
+				  _mm_unpacklo_epi16 (hi, zero));
+		_mm_storeu_si128 ((__m128i *) (chars + i + 12),
+				  _mm_unpackhi_epi16 (hi, zero));
+		s += 16;
+		i += 16;
+		continue;
+	    }
+	}
+#endif /* __SSE2__ */
+	if (* s < 0x80) {
+	    chars[i] = * s++;
+	}
+	else if (* s >= 0xE0 && * s < 0xF0 && end - s >= 3 &&
+		 (s[1] & 0xC0) == 0x80 && (s[2] & 0xC0) == 0x80) {
+
+	    /* Three bytes, which covers most of the characters of
+	       Chinese and Japanese. */
+
+	    chars[i] = ((s[0] & 0x0F) << 12) | ((s[1] & 0x3F) << 6) |
+		(s[2] & 0x3F);
+	    s += 3;
+	}
+	else {
+	    chars[i] = utf8_next_char (& s, end);
+	}
+	i++;
+    }
+    return i;
+}
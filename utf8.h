@@ -0,0 +1,7 @@
+#ifndef UTF8_H
+#define UTF8_H
+int utf8_n_chars (const unsigned char * s, int n);
+int utf8_next_char (const unsigned char ** s_ptr,
+		    const unsigned char * end);
+int utf8_decode_chars (const unsigned char * s, int n, int * chars);
+#endif /* UTF8_H */